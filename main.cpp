@@ -12,24 +12,73 @@
 #include <limits>
 #include <optional>
 #include <set>
+#include <filesystem>
+#include <functional>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <map>
+#include <chrono>
+#include <cmath>
+#include <tuple>
+#include <array>
+#include <cstddef>
+#include <cctype>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
-const int MAX_FRAMES_IN_FLIGHT = 2;
+const uint32_t MIN_FRAMES_IN_FLIGHT = 1;
+const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+const char* PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
+const uint64_t PRESENT_WAIT_TIMEOUT_NS = 100'000'000;
+
+// the startup report flags a first frame that takes longer than this
+const double STARTUP_BUDGET_MS = 100.0;
+
+// dynamic resolution: the share of the frame time the scene pass may take, how far down the render
+// resolution may go, and how much of the way to the wanted scale each GPU sample moves it
+const double RESOLUTION_HEADROOM = 0.8;
+const double MIN_RESOLUTION_SCALE = 0.5;
+const double RESOLUTION_DAMPING = 0.25;
+
+// telemetry: how often the overlay text, the memory budget and the --stats file are refreshed, and how many
+// times the running average frame time a frame has to take to count as a hitch
+const double TELEMETRY_INTERVAL_S = 0.5;
+const double HITCH_FACTOR = 2.0;
+
+// the overlay draws at most this many characters, each font pixel OVERLAY_PIXEL_SIZE screen pixels
+const uint32_t OVERLAY_MAX_GLYPHS = 2048;
+const uint32_t OVERLAY_PIXEL_SIZE = 2;
 
 const std::vector<const char*> validationLayers = {
     "VK_LAYER_KHRONOS_validation"
 };
 
-std::vector<const char*> deviceExtensions = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME
-};
-
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
+const bool enableShaderHotReload = false;
+const bool enableGpuProfiling = false;
 #else
 const bool enableValidationLayers = true;
+const bool enableShaderHotReload = true;
+const bool enableGpuProfiling = true;
 #endif
 
 VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
@@ -52,643 +101,6988 @@ struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
 
+    // a transfer-only family if the device has one, so uploads run beside rendering; otherwise graphicsFamily
+    std::optional<uint32_t> transferFamily;
+
+    // a compute family without graphics, so culling runs beside rendering; unset when there is none, or
+    // when it is also transferFamily, whose one queue the upload queue submits to from any thread
+    std::optional<uint32_t> computeFamily;
+
+    // false when rendering headless, where there is no surface to present to
+    bool presentRequired = true;
+
     bool isComplete() {
-        return graphicsFamily.has_value() && presentFamily.has_value();
+        return graphicsFamily.has_value() && (presentFamily.has_value() || !presentRequired);
     }
 };
 
-struct SwapChainSupportDetails {
-    VkSurfaceCapabilitiesKHR capabilities;
-    std::vector<VkSurfaceFormatKHR> formats;
-    std::vector<VkPresentModeKHR> presentModes;
-};
+struct Vertex {
+    float pos[2];
+    float color[3];
 
-class HelloTriangleApplication {
-public:
-    void run() {
-        initWindow();
-        initVulkan();
-        mainLoop();
-        cleanup();
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(Vertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescription;
     }
 
-private:
-    GLFWwindow* window;
+    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions{};
 
-    VkInstance instance;
-    VkDebugUtilsMessengerEXT debugMessenger;
-    VkSurfaceKHR surface;
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+        attributeDescriptions[0].offset = offsetof(Vertex, pos);
 
-    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-    VkDevice device;
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributeDescriptions[1].offset = offsetof(Vertex, color);
 
-    VkQueue graphicsQueue;
-    VkQueue presentQueue;
+        return attributeDescriptions;
+    }
+};
 
-    VkSwapchainKHR swapChain;
-    std::vector<VkImage> swapChainImages;
-    VkFormat swapChainImageFormat;
-    VkExtent2D swapChainExtent;
-    std::vector<VkImageView> swapChainImageViews;
-    std::vector<VkFramebuffer> swapChainFramebuffers;
+const std::vector<Vertex> vertices = {
+    {{0.0f, -0.5f}, {1.0f, 0.0f, 0.0f}},
+    {{0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},
+    {{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}}
+};
 
-    VkRenderPass renderPass;
-    VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
+const std::vector<uint16_t> indices = {
+    0, 1, 2
+};
 
-    VkCommandPool commandPool;
-    std::vector<VkCommandBuffer> commandBuffers;
+// one entry of the material table shader.vert reads through the bindless set (std430)
+struct MaterialData {
+    float tint[4];
+};
 
-    std::vector<VkSemaphore> imageAvailableSemaphores;
-    std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> inFlightFences;
-    uint32_t currentFrame = 0;
+const std::vector<MaterialData> materials = {
+    {{1.0f, 1.0f, 1.0f, 1.0f}},
+    {{1.0f, 0.6f, 0.6f, 1.0f}},
+    {{0.6f, 1.0f, 0.6f, 1.0f}},
+    {{0.6f, 0.6f, 1.0f, 1.0f}}
+};
 
-    bool framebufferResized = false;
+// Binary mesh file (.mesh), laid out so it can be memory-mapped and copied to the GPU as is:
+//   MeshFileHeader
+//   PackedVertex[vertexCount]            at vertexOffset
+//   uint16_t or uint32_t[indexCount]     at indexOffset, see indexSize
+//   Meshlet[meshletCount]                at meshletOffset
+// Meshlets cover the index stream in order, and vertices are stored in the order the meshlets first use
+// them, so any prefix of the meshlets only references a prefix of the vertices and can be drawn as soon
+// as that much has been streamed in.
+const char MESH_FILE_MAGIC[4] = {'M', 'S', 'H', '1'};
+const uint32_t MESH_FILE_VERSION = 1;
+
+struct MeshFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexSize;
+    uint32_t meshletCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t meshletOffset;
+};
 
-    void initWindow() {
-        glfwInit();
+// Frame log (--record / --replay), what the renderer was asked to draw each frame:
+//   FrameLogHeader
+//   then per frame a FrameLogRecord; when its flags have FRAME_LOG_SCENE it is followed by batchCount
+//   batches, each a FrameLogBatch and then its InstanceData columns (positionX, positionY, scale,
+//   rotation, materialId) of instanceCount values each
+// The scene is only stored on the frames that changed it, so a static scene costs 8 bytes a frame.
+const char FRAME_LOG_MAGIC[4] = {'F', 'R', 'M', '1'};
+const uint32_t FRAME_LOG_VERSION = 1;
+
+enum FrameLogFlags : uint32_t {
+    FRAME_LOG_SCENE = 1 << 0,
+    FRAME_LOG_DIRECT_DRAWS = 1 << 1,
+};
 
-        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+struct FrameLogHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    // set when the log is closed
+    uint32_t frameCount;
+    // whether the recording drew a .mesh file, which the replay then has to be given too
+    uint32_t drewMesh;
+};
 
-        window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
-        glfwSetWindowUserPointer(window, this);
-        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
-    }
+struct FrameLogRecord {
+    uint32_t flags;
+    uint32_t batchCount;
+};
 
-    static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
-        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
-        app->framebufferResized = true;
-    }
+struct FrameLogBatch {
+    uint32_t pipeline;
+    uint32_t mesh;
+    uint32_t instanceCount;
+};
 
-    void initVulkan() {
-        createInstance();
-        setupDebugMessenger();
-        createSurface();
-        pickPhysicalDevice();
-        createLogicalDevice();
-        createSwapChain();
-        createImageViews();
-        createRenderPass();
-        createGraphicsPipeline();
-        createFramebuffers();
-        createCommandPool();
-        createCommandBuffers();
-        createSyncObjects();
-    }
+// 16 bytes: position quantized to the header's bounds, octahedral normal, UV in [0, 1]
+struct PackedVertex {
+    uint16_t position[4];
+    int16_t normal[2];
+    uint16_t uv[2];
 
-    void mainLoop() {
-        while (!glfwWindowShouldClose(window)) {
-            glfwPollEvents();
-            drawFrame();
-        }
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(PackedVertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-        vkDeviceWaitIdle(device);
+        return bindingDescription;
     }
 
-    void cleanupSwapChain() {
-        for (auto framebuffer : swapChainFramebuffers) {
-            vkDestroyFramebuffer(device, framebuffer, nullptr);
-        }
+    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
 
-        for (auto imageView : swapChainImageViews) {
-            vkDestroyImageView(device, imageView, nullptr);
-        }
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+        attributeDescriptions[0].offset = offsetof(PackedVertex, position);
+
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R16G16_SNORM;
+        attributeDescriptions[1].offset = offsetof(PackedVertex, normal);
+
+        attributeDescriptions[2].binding = 0;
+        attributeDescriptions[2].location = 2;
+        attributeDescriptions[2].format = VK_FORMAT_R16G16_UNORM;
+        attributeDescriptions[2].offset = offsetof(PackedVertex, uv);
 
-        vkDestroySwapchainKHR(device, swapChain, nullptr);
+        return attributeDescriptions;
     }
+};
 
-    void cleanup() {
-        cleanupSwapChain();
+struct Meshlet {
+    uint32_t firstIndex;
+    uint32_t indexCount;
 
-        vkDestroyPipeline(device, graphicsPipeline, nullptr);
-        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    // one past the highest vertex this meshlet or any before it references
+    uint32_t vertexEnd;
 
-        vkDestroyRenderPass(device, renderPass, nullptr);
+    float center[3];
+    float radius;
+};
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-            vkDestroyFence(device, inFlightFences[i], nullptr);
-        }
+// matches the push_constant blocks of shader.vert and mesh.vert (std430, so the vec4s start at 16)
+struct PushConstants {
+    // distance between the instance SSBO's columns, in elements
+    uint32_t instanceStride;
+    // nonzero when gl_InstanceIndex indexes the culling pass's visible instance list
+    uint32_t visibleInstances;
+    // bindless index of the MaterialData table, and how many entries it has
+    uint32_t materialTable;
+    uint32_t materialCount;
+
+    // mesh.vert maps the dequantized [0, 1] position to clip space with these
+    float meshScale[4];
+    float meshOffset[4];
+};
 
-        vkDestroyCommandPool(device, commandPool, nullptr);
+struct AppConfig {
+    // 1 for the lowest latency, more to keep a GPU-bound device fed
+    uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
 
-        vkDestroyDevice(device, nullptr);
+    // 0 keeps the default MAILBOX-else-FIFO choice; presentMode overrides the policy entirely
+    double latencyTargetMs = 0.0;
+    std::optional<VkPresentModeKHR> presentMode;
 
-        if (enableValidationLayers) {
-            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
-        }
+    // hold back CPU work until the previous frame is on screen (VK_KHR_present_wait)
+    bool paceFrames = false;
 
-        vkDestroySurfaceKHR(instance, surface, nullptr);
-        vkDestroyInstance(instance, nullptr);
+    // run culling and the depth pyramid on a compute-only queue when the device has one
+    bool asyncCompute = true;
 
-        glfwDestroyWindow(window);
+    // render straight into the swapchain image views when the device has VK_KHR_dynamic_rendering
+    bool dynamicRendering = true;
 
-        glfwTerminate();
-    }
+    // samples per pixel; lowered to what the device supports
+    uint32_t msaaSamples = 1;
 
-    void recreateSwapChain() {
-        int width = 0, height = 0;
-        glfwGetFramebufferSize(window, &width, &height);
-        while (width == 0 || height == 0) {
-            glfwGetFramebufferSize(window, &width, &height);
-            glfwWaitEvents();
-        }
+    // hold this frame rate by scaling the render resolution with the measured GPU time; 0 always renders
+    // at the full swapchain size
+    double targetFps = 0.0;
 
-        vkDeviceWaitIdle(device);
+    // the GPU to run on, as its index in vkEnumeratePhysicalDevices() order or its deviceUUID; empty picks
+    // the suitable device with the highest score
+    std::string gpu;
 
-        cleanupSwapChain();
+    // render into offscreen images instead of a window
+    bool headless = false;
+    VkExtent2D headlessExtent = {WIDTH, HEIGHT};
 
-        createSwapChain();
-        createImageViews();
-        createFramebuffers();
-    }
+    // frames rendered by a headless run, and by each benchmark scenario
+    uint32_t frameCount = 1000;
+    std::string dumpFramesDirectory;
 
-    void createInstance() {
-        if (enableValidationLayers && !checkValidationLayerSupport()) {
-            throw std::runtime_error("validation layers requested, but not available!");
-        }
+    // write a Chrome trace of CPU and GPU frame phases here on exit
+    std::string tracePath;
 
-        VkApplicationInfo appInfo{};
-        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-        appInfo.pApplicationName = "Hello Triangle";
-        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.pEngineName = "No Engine";
-        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+    // show the telemetry overlay from the start (F3 toggles it), and keep the latest telemetry in this file
+    // as JSON, rewritten every TELEMETRY_INTERVAL_S
+    bool overlay = false;
+    std::string statsPath;
 
-        VkInstanceCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-        createInfo.pApplicationInfo = &appInfo;
+    // run the benchmark scenarios and write their results here as JSON
+    std::string benchmarkPath;
 
-        auto extensions = getRequiredExtensions();
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-        createInfo.ppEnabledExtensionNames = extensions.data();
-        createInfo.flags = VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;  // macOS specific fix
+    // write what every frame drew to this frame log
+    std::string recordPath;
 
-        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
-        if (enableValidationLayers) {
-            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-            createInfo.ppEnabledLayerNames = validationLayers.data();
+    // draw the frames of this frame log headless, as fast as the device allows, at the extent it was
+    // recorded at
+    std::string replayPath;
 
-            populateDebugMessengerCreateInfo(debugCreateInfo);
-            createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*) &debugCreateInfo;
-        } else {
-            createInfo.enabledLayerCount = 0;
+    // .mesh file drawn instead of the triangle
+    std::string meshPath;
 
-            createInfo.pNext = nullptr;
-        }
+    // write a test .mesh file of about this many triangles and exit
+    std::string generateMeshPath;
+    uint64_t generateMeshTriangles = 1'000'000;
+};
 
-        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create instance!");
-        }
-    }
+struct BenchmarkScenario {
+    std::string name;
+    uint32_t draws = 1;
+    uint32_t instancesPerDraw = 1;
 
-    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
-        createInfo = {};
-        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-        createInfo.pfnUserCallback = debugCallback;
-    }
+    // resize the window every this many frames; 0 never resizes
+    uint32_t resizeInterval = 0;
 
-    void setupDebugMessenger() {
-        if (!enableValidationLayers) return;
+    // unset renders with presentation unthrottled
+    std::optional<VkPresentModeKHR> presentMode;
+};
 
-        VkDebugUtilsMessengerCreateInfoEXT createInfo;
-        populateDebugMessengerCreateInfo(createInfo);
+struct BenchmarkResult {
+    std::string scenario;
+    uint32_t triangles;
+    uint32_t draws;
+    std::string presentMode;
+    std::vector<double> frameTimesMs;
+    std::vector<double> submitCpuMs;
+};
 
-        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS) {
-            throw std::runtime_error("failed to set up debug messenger!");
-        }
+// the inverse of parsePresentMode()
+const char* presentModeName(VkPresentModeKHR presentMode) {
+    switch (presentMode) {
+        case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo-relaxed";
+        case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+        case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+        default: return "other";
     }
+}
 
-    void createSurface() {
-        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create window surface!");
+// lowercase hex in the usual 8-4-4-4-12 grouping
+std::string formatUuid(const std::array<uint8_t, VK_UUID_SIZE>& uuid) {
+    static const char* DIGITS = "0123456789abcdef";
+
+    std::string text;
+    for (uint32_t i = 0; i < VK_UUID_SIZE; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            text += '-';
         }
+        text += DIGITS[uuid[i] >> 4];
+        text += DIGITS[uuid[i] & 0xf];
     }
+    return text;
+}
 
-    void pickPhysicalDevice() {
-        uint32_t deviceCount = 0;
-        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+// Whole decimal numbers only, so "-1" and "4294967298" are errors instead of wrapping into range; what
+// names the value in the error.
+uint64_t parseUnsigned(const std::string& what, const std::string& text, uint64_t max) {
+    bool digits = !text.empty() && std::all_of(text.begin(), text.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+    uint64_t value = 0;
+    try {
+        value = digits ? std::stoull(text) : 0;
+    } catch (const std::out_of_range&) {
+        digits = false;
+    }
+    if (!digits || value > max) {
+        throw std::invalid_argument(what + " must be a whole number up to " + std::to_string(max) + ", got " + text);
+    }
 
-        if (deviceCount == 0) {
-            throw std::runtime_error("failed to find GPUs with Vulkan support!");
-        }
+    return value;
+}
 
-        std::vector<VkPhysicalDevice> devices(deviceCount);
-        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+double parseNumber(const std::string& what, const std::string& text) {
+    size_t end = 0;
+    double value = 0.0;
+    try {
+        value = std::stod(text, &end);
+    } catch (const std::logic_error&) {
+        end = 0;
+    }
+    if (end == 0 || end != text.size() || !std::isfinite(value)) {
+        throw std::invalid_argument(what + " must be a number, got " + text);
+    }
 
-        for (const auto& device : devices) {
-            if (isDeviceSuitable(device)) {
-                physicalDevice = device;
-                break;
-            }
-        }
+    return value;
+}
 
-        if (physicalDevice == VK_NULL_HANDLE) {
-            throw std::runtime_error("failed to find a suitable GPU!");
-        }
+struct LatencyStats {
+    uint64_t samples = 0;
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+
+    void add(double ms) {
+        samples++;
+        totalMs += ms;
+        maxMs = std::max(maxMs, ms);
     }
 
-    void createLogicalDevice() {
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    double averageMs() const {
+        return samples > 0 ? totalMs / samples : 0.0;
+    }
+};
 
-        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+struct MemoryAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
 
-        float queuePriority = 1.0f;
-        for (uint32_t queueFamily : uniqueQueueFamilies) {
-            VkDeviceQueueCreateInfo queueCreateInfo{};
-            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-            queueCreateInfo.queueFamilyIndex = queueFamily;
-            queueCreateInfo.queueCount = 1;
-            queueCreateInfo.pQueuePriorities = &queuePriority;
-            queueCreateInfos.push_back(queueCreateInfo);
-        }
+    // set for host-visible memory, which stays mapped for the block's lifetime
+    void* data = nullptr;
 
-        VkPhysicalDeviceFeatures deviceFeatures{};
-        //std::vector<const char*> deviceExtensions;
-        if (enableValidationLayers) 
-        {
-          deviceExtensions.push_back(VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME); // needed for macOS
-        }
-        VkDeviceCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    // where the allocation came from, for DeviceAllocator::free()
+    uint32_t memoryType = 0;
+    uint32_t pool = UINT32_MAX;
+    uint32_t block = 0;
+    uint32_t slot = 0;
+};
 
-        createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-        createInfo.pQueueCreateInfos = queueCreateInfos.data();
+// a job system worker's pool for one frame, so workers record secondaries without sharing a pool; the
+// buffers are kept across frames and handed out again after the pool is reset
+struct WorkerCommandPool {
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> secondaries;
+    size_t usedSecondaries = 0;
+};
 
-        createInfo.pEnabledFeatures = &deviceFeatures;
+// Everything one frame in flight owns. A slot is reused only after its serial has retired on the graphics
+// timeline, which is also when its command pools are reset wholesale.
+struct FrameContext {
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    std::vector<WorkerCommandPool> workerPools;
+
+    // async compute only: culling and the depth pyramid, submitted to the compute queue ahead of
+    // commandBuffer whenever computeRecorded is set
+    VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+    VkCommandBuffer computeCommandBuffer = VK_NULL_HANDLE;
+    bool computeRecorded = false;
+
+    VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
+    VkSemaphore renderFinishedSemaphore = VK_NULL_HANDLE;
+
+    // serial of the last frame submitted from this slot
+    uint64_t serial = 0;
+
+    // headless only: host-visible copy of this frame's render target
+    VkBuffer readbackBuffer = VK_NULL_HANDLE;
+    MemoryAllocation readbackMemory;
+
+    // this frame's copy of the batched scene: the instance and batch SSBOs, rewritten only when sceneVersion
+    // falls behind the scene, and what the culling pass writes from them every frame, the visible instance
+    // list and the indirect counts + commands
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    VkBuffer instanceBuffer = VK_NULL_HANDLE;
+    MemoryAllocation instanceMemory;
+    VkBuffer visibleBuffer = VK_NULL_HANDLE;
+    MemoryAllocation visibleMemory;
+    uint32_t instanceCapacity = 0;
+    VkBuffer batchBuffer = VK_NULL_HANDLE;
+    MemoryAllocation batchMemory;
+    VkBuffer indirectBuffer = VK_NULL_HANDLE;
+    MemoryAllocation indirectMemory;
+    uint32_t indirectCapacity = 0;
+    uint64_t sceneVersion = 0;
+
+    // what the copy holds; recording reads these rather than the scene, which the next frame's simulation
+    // may already be changing
+    uint32_t instanceCount = 0;
+    uint32_t batchCount = 0;
+
+    // the depth pyramid descriptorSet currently samples
+    VkImageView depthPyramidView = VK_NULL_HANDLE;
+
+    // the render resolution scale the frame was recorded with, to judge its GPU time by
+    double resolutionScale = 1.0;
+
+    // this frame's copy of the overlay text, bindless index overlayBinding, rewritten when overlayVersion
+    // falls behind the text
+    VkBuffer overlayBuffer = VK_NULL_HANDLE;
+    MemoryAllocation overlayMemory;
+    uint32_t overlayBinding = 0;
+    uint32_t overlayGlyphCount = 0;
+    uint64_t overlayVersion = 0;
+};
 
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+// matches the push_constant block of cull.comp
+struct CullPushConstants {
+    uint32_t instanceStride;
+    uint32_t instanceCount;
+    uint32_t batchCount;
+    // offsets into the indirect buffer, in uint32_t
+    uint32_t commandsOffset;
+    uint32_t countersOffset;
+    // without drawIndirectCount every batch keeps its own command slot, empty or not
+    uint32_t compactDraws;
+    uint32_t pyramidLevels;
+    uint32_t padding;
+    float pyramidSize[2];
+};
 
-        if (enableValidationLayers) {
-            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-            createInfo.ppEnabledLayerNames = validationLayers.data();
-        } else {
-            createInfo.enabledLayerCount = 0;
-        }
+// matches the push_constant block of overlay.vert; fits in the shared layout's PushConstants range
+struct OverlayPushConstants {
+    uint32_t glyphBuffer;
+    uint32_t glyphCount;
+    // one text cell, and the top left corner of the text, in clip space
+    float cellSize[2];
+    float origin[2];
+};
 
-        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create logical device!");
-        }
+// matches the push_constant block of depth_pyramid.comp
+struct DepthPyramidPushConstants {
+    uint32_t sourceSize[2];
+    uint32_t destinationSize[2];
+};
 
-        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-        vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
-    }
+// one per DrawBatcher batch; matches DrawBatch in cull.comp
+struct GpuDrawBatch {
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+    uint32_t group;
+    uint32_t groupFirstCommand;
+    float boundingRadius;
+};
 
-    void createSwapChain() {
-        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+struct OffscreenTarget {
+    VkImage image = VK_NULL_HANDLE;
+    MemoryAllocation memory;
+};
 
-        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-        VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
-        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+struct SwapChainSupportDetails {
+    VkSurfaceCapabilitiesKHR capabilities;
+    std::vector<VkSurfaceFormatKHR> formats;
+    std::vector<VkPresentModeKHR> presentModes;
+};
 
-        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-        if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
-            imageCount = swapChainSupport.capabilities.maxImageCount;
-        }
+// Everything device selection and creation ask a physical device, queried once per device. The surface
+// capabilities are left out: their current extent changes with the window.
+struct DeviceCapabilities {
+    VkPhysicalDeviceProperties properties{};
+    VkPhysicalDeviceFeatures features{};
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    std::array<uint8_t, VK_UUID_SIZE> uuid{};
 
-        VkSwapchainCreateInfoKHR createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-        createInfo.surface = surface;
+    std::vector<VkQueueFamilyProperties> queueFamilies;
+    QueueFamilyIndices queueFamilyIndices;
 
-        createInfo.minImageCount = imageCount;
-        createInfo.imageFormat = surfaceFormat.format;
-        createInfo.imageColorSpace = surfaceFormat.colorSpace;
-        createInfo.imageExtent = extent;
-        createInfo.imageArrayLayers = 1;
-        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // sorted, for hasExtension()
+    std::vector<std::string> extensions;
 
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-        uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+    bool presentWait = false;
+    bool dynamicRendering = false;
 
-        if (indices.graphicsFamily != indices.presentFamily) {
-            createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-            createInfo.queueFamilyIndexCount = 2;
-            createInfo.pQueueFamilyIndices = queueFamilyIndices;
-        } else {
-            createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    // empty when rendering headless
+    std::vector<VkSurfaceFormatKHR> surfaceFormats;
+    std::vector<VkPresentModeKHR> presentModes;
+
+    bool hasExtension(const char* extensionName) const {
+        return std::binary_search(extensions.begin(), extensions.end(), extensionName);
+    }
+};
+
+// Read-only view of a whole file mapped into memory. Mappings start on a page boundary, so the data is
+// suitably aligned for SPIR-V words without copying it into a temporary buffer.
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string& filename) {
+#ifdef _WIN32
+        fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("failed to open file!");
+        }
+
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(fileHandle, &fileSize);
+        mappedSize = static_cast<size_t>(fileSize.QuadPart);
+
+        if (mappedSize > 0) {
+            mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mappingHandle != nullptr) {
+                mappedData = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+            }
+            if (mappedData == nullptr) {
+                release();
+                throw std::runtime_error("failed to map file!");
+            }
+        }
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open file!");
+        }
+
+        struct stat fileInfo;
+        if (fstat(fd, &fileInfo) != 0) {
+            close(fd);
+            throw std::runtime_error("failed to open file!");
+        }
+        mappedSize = static_cast<size_t>(fileInfo.st_size);
+
+        if (mappedSize > 0) {
+            void* mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("failed to map file!");
+            }
+            mappedData = static_cast<const char*>(mapping);
+        }
+
+        close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+        release();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            release();
+            std::swap(mappedData, other.mappedData);
+            std::swap(mappedSize, other.mappedSize);
+#ifdef _WIN32
+            std::swap(fileHandle, other.fileHandle);
+            std::swap(mappingHandle, other.mappingHandle);
+#endif
+        }
+        return *this;
+    }
+
+    const char* data() const { return mappedData; }
+    size_t size() const { return mappedSize; }
+    bool empty() const { return mappedSize == 0; }
+
+    // asks the OS to start reading the whole file in, so that later mappings of it find it in memory
+    void prefetch() const {
+        if (mappedData == nullptr) {
+            return;
+        }
+#ifdef _WIN32
+        WIN32_MEMORY_RANGE_ENTRY range{const_cast<char*>(mappedData), mappedSize};
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+        madvise(const_cast<char*>(mappedData), mappedSize, MADV_WILLNEED);
+#endif
+    }
+
+private:
+    const char* mappedData = nullptr;
+    size_t mappedSize = 0;
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mappingHandle = nullptr;
+#endif
+
+    void release() {
+#ifdef _WIN32
+        if (mappedData != nullptr) UnmapViewOfFile(mappedData);
+        if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+        mappingHandle = nullptr;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (mappedData != nullptr) munmap(const_cast<char*>(mappedData), mappedSize);
+#endif
+        mappedData = nullptr;
+        mappedSize = 0;
+    }
+};
+
+// Shader modules keyed by a hash of their SPIR-V words, so identical code is only ever turned into one
+// VkShaderModule no matter how many pipelines or file names refer to it. Safe to call from any thread.
+class ShaderModuleCache {
+public:
+    explicit ShaderModuleCache(VkDevice device) : device(device) {}
+
+    VkShaderModule get(const MappedFile& code) {
+        const uint32_t SPIRV_MAGIC = 0x07230203;
+
+        if (code.size() < sizeof(uint32_t) || code.size() % sizeof(uint32_t) != 0 ||
+            reinterpret_cast<uintptr_t>(code.data()) % alignof(uint32_t) != 0) {
+            throw std::runtime_error("invalid SPIR-V binary!");
+        }
+
+        const uint32_t* words = reinterpret_cast<const uint32_t*>(code.data());
+        size_t wordCount = code.size() / sizeof(uint32_t);
+        if (words[0] != SPIRV_MAGIC) {
+            throw std::runtime_error("invalid SPIR-V binary!");
+        }
+
+        Key key{hashWords(words, wordCount), code.size()};
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto found = modules.find(key);
+        if (found != modules.end()) {
+            return found->second;
+        }
+
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = code.size();
+        createInfo.pCode = words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader module!");
+        }
+
+        modules.emplace(key, shaderModule);
+        return shaderModule;
+    }
+
+    void destroy() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto& [key, shaderModule] : modules) {
+            vkDestroyShaderModule(device, shaderModule, nullptr);
+        }
+        modules.clear();
+    }
+
+private:
+    using Key = std::pair<uint64_t, size_t>;
+
+    VkDevice device;
+    std::map<Key, VkShaderModule> modules;
+    std::mutex mutex;
+
+    // 64-bit FNV-1a over whole words
+    static uint64_t hashWords(const uint32_t* words, size_t wordCount) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < wordCount; i++) {
+            hash ^= words[i];
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+};
+
+// Records named CPU time spans into one ring buffer per thread and writes them out as a Chrome trace
+// (chrome://tracing, ui.perfetto.dev). Recording takes no locks: each ring has a single writer, and the
+// only lock is taken once per thread when its ring is registered. Rings wrap, keeping the newest events.
+class Tracer {
+public:
+    struct Event {
+        const char* name;
+        int64_t startNs;
+        int64_t durationNs;
+    };
+
+    static const size_t RING_CAPACITY = 1 << 16;
+
+    static Tracer& instance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    // all trace timestamps share this clock so CPU and GPU tracks line up
+    static int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void setEnabled(bool enable) {
+        enabled.store(enable, std::memory_order_relaxed);
+    }
+
+    bool isEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // name must be a string literal; it is shown as the thread's track name in the trace
+    static void nameCurrentThread(const char* name) {
+        currentThreadName() = name;
+    }
+
+    void record(const char* name, int64_t startNs, int64_t durationNs) {
+        Ring*& ring = currentThreadRing();
+        if (ring == nullptr) {
+            ring = registerRing(currentThreadName());
+        }
+        ring->push({name, startNs, durationNs});
+    }
+
+    // GPU spans already converted to the CPU clock; only called from the thread that collects GPU timings
+    void recordGpu(const char* name, int64_t startNs, int64_t durationNs) {
+        if (!gpuRing) {
+            gpuRing = std::make_unique<Ring>(0, "gpu");
+        }
+        gpuRing->push({name, startNs, durationNs});
+    }
+
+    // only call once the traced threads have stopped recording, e.g. during shutdown
+    bool writeChromeTrace(const std::string& path) {
+        std::ofstream file(path);
+        if (!file) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        auto writeRing = [&](const Ring& ring, uint32_t pid) {
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << ring.threadId
+                << ",\"args\":{\"name\":\"" << ring.threadName << "\"}}";
+            first = false;
+
+            uint64_t end = ring.head.load(std::memory_order_acquire);
+            uint64_t begin = end > RING_CAPACITY ? end - RING_CAPACITY : 0;
+            for (uint64_t i = begin; i < end; i++) {
+                const Event& event = ring.events[i % RING_CAPACITY];
+                file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << ring.threadId
+                    << ",\"ts\":" << event.startNs / 1000.0 << ",\"dur\":" << event.durationNs / 1000.0 << "}";
+            }
+        };
+
+        for (const auto& ring : rings) {
+            writeRing(*ring, 1);
+        }
+        if (gpuRing) {
+            writeRing(*gpuRing, 2);
+        }
+        file << "\n]}\n";
+
+        return static_cast<bool>(file);
+    }
+
+private:
+    struct Ring {
+        uint32_t threadId;
+        const char* threadName;
+        std::unique_ptr<Event[]> events{new Event[RING_CAPACITY]};
+        std::atomic<uint64_t> head{0};
+
+        Ring(uint32_t threadId, const char* threadName) : threadId(threadId), threadName(threadName) {}
+
+        void push(const Event& event) {
+            uint64_t index = head.load(std::memory_order_relaxed);
+            events[index % RING_CAPACITY] = event;
+            head.store(index + 1, std::memory_order_release);
+        }
+    };
+
+    std::atomic<bool> enabled{false};
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::unique_ptr<Ring> gpuRing;
+
+    static const char*& currentThreadName() {
+        thread_local const char* name = "thread";
+        return name;
+    }
+
+    static Ring*& currentThreadRing() {
+        thread_local Ring* ring = nullptr;
+        return ring;
+    }
+
+    Ring* registerRing(const char* threadName) {
+        std::lock_guard<std::mutex> lock(mutex);
+        rings.push_back(std::make_unique<Ring>(static_cast<uint32_t>(rings.size() + 1), threadName));
+        return rings.back().get();
+    }
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name)
+        : name(name), startNs(Tracer::instance().isEnabled() ? Tracer::nowNs() : -1) {}
+
+    ~TraceScope() {
+        if (startNs >= 0) {
+            Tracer::instance().record(name, startNs, Tracer::nowNs() - startNs);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    int64_t startNs;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// times the rest of the enclosing block on the calling thread when --trace is given
+#define TRACE_SCOPE(name) TraceScope PROFILE_CONCAT(traceScope, __LINE__)(name)
+
+// Counters and gauges any thread can update without taking a lock, read by the overlay and the --stats
+// export. Counters only go up, so rates come from the difference between two snapshots; gauges hold the
+// latest value.
+class Telemetry {
+public:
+    enum Counter {
+        Frames,
+        DrawCalls,
+        PipelinesCompiled,
+        BytesUploaded,
+        SwapchainRecreations,
+        Hitches,
+        COUNTER_COUNT
+    };
+
+    enum Gauge {
+        FrameTimeMs,
+        CpuSubmitMs,
+        // 0 without GPU timings
+        GpuSceneMs,
+        ResolutionScale,
+        GAUGE_COUNT
+    };
+
+    struct HeapUsage {
+        VkDeviceSize usage = 0;
+        VkDeviceSize budget = 0;
+        bool deviceLocal = false;
+    };
+
+    struct Snapshot {
+        std::chrono::steady_clock::time_point time;
+        std::array<uint64_t, COUNTER_COUNT> counters{};
+        std::array<double, GAUGE_COUNT> gauges{};
+        std::vector<HeapUsage> heaps;
+    };
+
+    static Telemetry& instance() {
+        static Telemetry telemetry;
+        return telemetry;
+    }
+
+    static const char* name(Counter counter) {
+        static const char* names[COUNTER_COUNT] = {"frames", "draw_calls", "pipelines_compiled", "bytes_uploaded",
+            "swapchain_recreations", "hitches"};
+        return names[counter];
+    }
+
+    static const char* name(Gauge gauge) {
+        static const char* names[GAUGE_COUNT] = {"frame_time_ms", "cpu_submit_ms", "gpu_scene_ms", "resolution_scale"};
+        return names[gauge];
+    }
+
+    void add(Counter counter, uint64_t amount = 1) {
+        counters[counter].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    void set(Gauge gauge, double value) {
+        gauges[gauge].store(value, std::memory_order_relaxed);
+    }
+
+    // written by one thread at a time, whichever queries the device
+    void setHeaps(const std::vector<HeapUsage>& heaps) {
+        uint32_t count = std::min(static_cast<uint32_t>(heaps.size()), VK_MAX_MEMORY_HEAPS);
+        for (uint32_t i = 0; i < count; i++) {
+            heapUsage[i].store(heaps[i].usage, std::memory_order_relaxed);
+            heapBudget[i].store(heaps[i].budget, std::memory_order_relaxed);
+            heapDeviceLocal[i].store(heaps[i].deviceLocal, std::memory_order_relaxed);
+        }
+        heapCount.store(count, std::memory_order_release);
+    }
+
+    // the values are read one by one, so a snapshot taken mid-update can mix old and new ones
+    Snapshot snapshot() const {
+        Snapshot snapshot;
+        snapshot.time = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < COUNTER_COUNT; i++) {
+            snapshot.counters[i] = counters[i].load(std::memory_order_relaxed);
+        }
+        for (uint32_t i = 0; i < GAUGE_COUNT; i++) {
+            snapshot.gauges[i] = gauges[i].load(std::memory_order_relaxed);
+        }
+
+        uint32_t count = heapCount.load(std::memory_order_acquire);
+        snapshot.heaps.resize(count);
+        for (uint32_t i = 0; i < count; i++) {
+            snapshot.heaps[i].usage = heapUsage[i].load(std::memory_order_relaxed);
+            snapshot.heaps[i].budget = heapBudget[i].load(std::memory_order_relaxed);
+            snapshot.heaps[i].deviceLocal = heapDeviceLocal[i].load(std::memory_order_relaxed);
+        }
+        return snapshot;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+    std::array<std::atomic<double>, GAUGE_COUNT> gauges{};
+    std::array<std::atomic<VkDeviceSize>, VK_MAX_MEMORY_HEAPS> heapUsage{};
+    std::array<std::atomic<VkDeviceSize>, VK_MAX_MEMORY_HEAPS> heapBudget{};
+    std::array<std::atomic<bool>, VK_MAX_MEMORY_HEAPS> heapDeviceLocal{};
+    std::atomic<uint32_t> heapCount{0};
+};
+
+// counts a group of unfinished tasks, so whoever submitted them can wait for them
+class TaskCounter {
+public:
+    bool done() const {
+        return pending.load(std::memory_order_acquire) == 0;
+    }
+
+private:
+    friend class JobSystem;
+    std::atomic<uint32_t> pending{0};
+};
+
+// tasks with dependencies; JobSystem::run() starts each one once everything it depends on has finished
+class TaskGraph {
+public:
+    using TaskId = uint32_t;
+
+    TaskId add(const char* name, std::function<void()> work, std::initializer_list<TaskId> dependencies = {}) {
+        TaskId id = static_cast<TaskId>(nodes.size());
+        nodes.emplace_back();
+
+        Node& node = nodes.back();
+        node.name = name;
+        node.work = std::move(work);
+        node.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        for (TaskId dependency : dependencies) {
+            nodes[dependency].dependents.push_back(id);
+        }
+
+        return id;
+    }
+
+private:
+    friend class JobSystem;
+
+    struct Node {
+        const char* name;
+        std::function<void()> work;
+        std::vector<TaskId> dependents;
+        uint32_t dependencyCount = 0;
+        std::atomic<uint32_t> unfinishedDependencies{0};
+    };
+    std::deque<Node> nodes;
+};
+
+// The one scheduler all work off the render thread goes through, with a worker per core.
+//
+// Frame work (task graphs and parallelFor()) goes into per-worker deques: a worker takes its own tasks from
+// the back and steals from the front of the others' once it runs dry. A thread waiting on frame work runs
+// frame tasks meanwhile; the render thread does so as worker workerCount() - 1, so callers can keep
+// per-thread state (a command pool, say) per worker index.
+//
+// Background work (pipeline compiles, mesh streaming, shader polling) waits in a shared queue that only
+// the worker threads take from, and only once they find no frame work, so a long compile never lands on
+// the render thread or holds up a frame.
+class JobSystem {
+public:
+    using Job = std::function<void(uint32_t jobIndex, uint32_t workerIndex)>;
+
+    explicit JobSystem(size_t threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1)
+        : queues(threadCount + 1) {
+        for (size_t i = 0; i < threadCount; i++) {
+            workers.emplace_back([this, i] {
+                Tracer::nameCurrentThread("worker");
+                currentWorkerIndex() = static_cast<uint32_t>(i);
+                workerLoop(static_cast<uint32_t>(i));
+            });
+        }
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        stateChanged.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    uint32_t workerCount() const {
+        return static_cast<uint32_t>(queues.size());
+    }
+
+    // Background tasks handle their own errors. Anything that escapes one is reported here and dropped,
+    // never left for whichever run() or parallelFor() the render thread happens to call next.
+    void submit(std::function<void()> task, TaskCounter& counter) {
+        counter.pending.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            background.push_back({[task = std::move(task)](uint32_t) {
+                try {
+                    task();
+                } catch (const std::exception& e) {
+                    std::cerr << "background task failed: " << e.what() << std::endl;
+                } catch (...) {
+                    std::cerr << "background task failed!" << std::endl;
+                }
+            }, &counter});
+        }
+        stateChanged.notify_all();
+    }
+
+    // blocks without running anything; for waiting on background work
+    void wait(const TaskCounter& counter) {
+        std::unique_lock<std::mutex> lock(mutex);
+        stateChanged.wait(lock, [&] { return counter.done(); });
+    }
+
+    // runs the graph and returns once every task in it has finished; the first exception a task throws is
+    // rethrown here
+    void run(TaskGraph& graph) {
+        if (graph.nodes.empty()) {
+            return;
+        }
+
+        TaskCounter counter;
+        counter.pending.store(static_cast<uint32_t>(graph.nodes.size()), std::memory_order_relaxed);
+        for (auto& node : graph.nodes) {
+            node.unfinishedDependencies.store(node.dependencyCount, std::memory_order_relaxed);
+        }
+
+        uint32_t workerIndex = callerWorkerIndex();
+        for (TaskGraph::TaskId id = 0; id < graph.nodes.size(); id++) {
+            if (graph.nodes[id].dependencyCount == 0) {
+                pushFrameTask(workerIndex, graphTask(graph, id, counter));
+            }
+        }
+
+        waitForFrameWork(counter);
+    }
+
+    // runs job(i, workerIndex) for every i in [0, count) and returns once all of them have finished; the
+    // first exception a job throws is rethrown here
+    void parallelFor(uint32_t count, const Job& job) {
+        uint32_t workerIndex = callerWorkerIndex();
+        if (count <= 1) {
+            for (uint32_t i = 0; i < count; i++) {
+                job(i, workerIndex);
+            }
+            return;
+        }
+
+        TaskCounter counter;
+        counter.pending.store(count, std::memory_order_relaxed);
+
+        // dealt out round-robin, so every queue starts with a share and stealing only evens out the tail
+        for (uint32_t i = 0; i < count; i++) {
+            pushFrameTask((workerIndex + i) % workerCount(), {[&job, i](uint32_t worker) { job(i, worker); }, &counter});
+        }
+
+        waitForFrameWork(counter);
+    }
+
+private:
+    static const uint32_t NOT_A_WORKER = std::numeric_limits<uint32_t>::max();
+
+    struct Task {
+        std::function<void(uint32_t workerIndex)> work;
+        TaskCounter* counter = nullptr;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    std::atomic<uint32_t> queuedFrameTasks{0};
+
+    std::mutex mutex;
+    std::condition_variable stateChanged;
+    std::deque<Task> background;
+    bool stopping = false;
+    // only frame work lands here; submit() keeps background errors out
+    std::exception_ptr firstError;
+
+    static uint32_t& currentWorkerIndex() {
+        thread_local uint32_t index = NOT_A_WORKER;
+        return index;
+    }
+
+    // any thread that is not a worker counts as the render thread's slot
+    uint32_t callerWorkerIndex() const {
+        uint32_t index = currentWorkerIndex();
+        return index == NOT_A_WORKER ? workerCount() - 1 : index;
+    }
+
+    Task graphTask(TaskGraph& graph, TaskGraph::TaskId id, TaskCounter& counter) {
+        return {[this, &graph, id, &counter](uint32_t workerIndex) {
+            TaskGraph::Node& node = graph.nodes[id];
+            try {
+                TRACE_SCOPE(node.name);
+                node.work();
+            } catch (...) {
+                recordError();
+            }
+
+            // even after a failure, so run() still returns; queued before this task's count drops, so the
+            // graph cannot look finished in between
+            for (TaskGraph::TaskId dependent : node.dependents) {
+                if (graph.nodes[dependent].unfinishedDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    pushFrameTask(workerIndex, graphTask(graph, dependent, counter));
+                }
+            }
+        }, &counter};
+    }
+
+    void pushFrameTask(uint32_t queueIndex, Task task) {
+        {
+            Queue& queue = queues[queueIndex];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        queuedFrameTasks.fetch_add(1, std::memory_order_release);
+
+        // taking the lock orders the push before any sleeper's next look at the queues
+        { std::lock_guard<std::mutex> lock(mutex); }
+        stateChanged.notify_all();
+    }
+
+    bool takeFrameTask(uint32_t workerIndex, Task& task) {
+        if (queuedFrameTasks.load(std::memory_order_acquire) == 0) {
+            return false;
+        }
+
+        for (size_t offset = 0; offset < queues.size(); offset++) {
+            Queue& queue = queues[(workerIndex + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+
+            // newest first from our own queue, oldest first from anyone else's
+            if (offset == 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            queuedFrameTasks.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        return false;
+    }
+
+    void recordError() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!firstError) {
+            firstError = std::current_exception();
+        }
+    }
+
+    void execute(Task& task, uint32_t workerIndex) {
+        try {
+            task.work(workerIndex);
+        } catch (...) {
+            recordError();
+        }
+
+        if (task.counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            { std::lock_guard<std::mutex> lock(mutex); }
+            stateChanged.notify_all();
+        }
+    }
+
+    void waitForFrameWork(const TaskCounter& counter) {
+        uint32_t workerIndex = callerWorkerIndex();
+        while (!counter.done()) {
+            Task task;
+            if (takeFrameTask(workerIndex, task)) {
+                execute(task, workerIndex);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            stateChanged.wait(lock, [&] { return counter.done() || queuedFrameTasks.load(std::memory_order_acquire) > 0; });
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (firstError) {
+            std::exception_ptr error = firstError;
+            firstError = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    void workerLoop(uint32_t workerIndex) {
+        while (true) {
+            Task task;
+            if (takeFrameTask(workerIndex, task)) {
+                execute(task, workerIndex);
+                continue;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                stateChanged.wait(lock, [this] {
+                    return stopping || !background.empty() || queuedFrameTasks.load(std::memory_order_acquire) > 0;
+                });
+                if (stopping) {
+                    return;
+                }
+                if (background.empty()) {
+                    continue;
+                }
+                task = std::move(background.front());
+                background.pop_front();
+            }
+
+            execute(task, workerIndex);
+        }
+    }
+};
+
+// One piece of startup work handed to a worker so the caller can get on with something else. wait()
+// rethrows whatever the work threw, which JobSystem::submit() would otherwise only report.
+class BackgroundTask {
+public:
+    void start(JobSystem& jobs, std::function<void()> work) {
+        jobs.submit([this, work = std::move(work)] {
+            try {
+                work();
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }, counter);
+    }
+
+    void wait(JobSystem& jobs) {
+        jobs.wait(counter);
+        if (error) {
+            std::exception_ptr thrown = error;
+            error = nullptr;
+            std::rethrow_exception(thrown);
+        }
+    }
+
+private:
+    TaskCounter counter;
+    std::exception_ptr error;
+};
+
+// Wall-clock time of each startup phase on the main thread, from construction to the first frame.
+class StartupTimer {
+public:
+    // ends the phase running since the previous call
+    void phase(const char* name) {
+        auto now = std::chrono::steady_clock::now();
+        phases.push_back({name, std::chrono::duration<double, std::milli>(now - phaseStart).count()});
+        phaseStart = now;
+    }
+
+    double elapsedMs() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void report(double budgetMs) const {
+        auto tenths = [](double ms) { return std::round(ms * 10.0) / 10.0; };
+        double total = elapsedMs();
+
+        std::cout << "startup:";
+        for (const auto& [name, ms] : phases) {
+            std::cout << " " << name << " " << tenths(ms) << " ms,";
+        }
+        std::cout << " first frame after " << tenths(total) << " ms";
+        if (total > budgetMs) {
+            std::cout << " (over the " << budgetMs << " ms budget)";
+        }
+        std::cout << std::endl;
+    }
+
+private:
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point phaseStart = start;
+    std::vector<std::pair<const char*, double>> phases;
+};
+
+// A fixed-size ring for exactly one producer thread and one consumer thread. Neither side ever blocks or
+// takes a lock: push() fails when the ring is full and pop() when it is empty.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    bool push(const T& value) {
+        size_t write = writeIndex.load(std::memory_order_relaxed);
+        if (write - readIndex.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+
+        slots[write & (Capacity - 1)] = value;
+        writeIndex.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        size_t read = readIndex.load(std::memory_order_relaxed);
+        if (read == writeIndex.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = slots[read & (Capacity - 1)];
+        readIndex.store(read + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, Capacity> slots{};
+
+    // on separate cache lines so the two threads do not keep stealing each other's
+    alignas(64) std::atomic<size_t> writeIndex{0};
+    alignas(64) std::atomic<size_t> readIndex{0};
+};
+
+// what the main thread's GLFW callbacks hand to the render thread
+struct WindowEvent {
+    enum class Type {
+        Resize,
+        Key
+    };
+
+    Type type = Type::Resize;
+    int width = 0;
+    int height = 0;
+    int key = 0;
+    int action = 0;
+    std::chrono::steady_clock::time_point time;
+};
+
+enum class VertexLayout {
+    Basic,
+    PackedMesh,
+    // no vertex buffer; the shader makes its vertices from gl_VertexIndex
+    None
+};
+
+struct PipelineDescription {
+    std::string vertShader;
+    std::string fragShader;
+
+    // GLSL the SPIR-V above is built from; left empty for pipelines that are not hot-reloadable
+    std::string vertSource;
+    std::string fragSource;
+
+    VertexLayout vertexLayout = VertexLayout::Basic;
+
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+    bool blendEnable = false;
+    bool depthTest = true;
+
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+
+    // what the pipeline renders into when renderPass is VK_NULL_HANDLE (dynamic rendering)
+    VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+using PipelineHandle = uint32_t;
+const PipelineHandle INVALID_PIPELINE_HANDLE = std::numeric_limits<PipelineHandle>::max();
+
+// Compiles pipelines as background tasks on the JobSystem and hands out whatever is ready. Everything but
+// the compiles runs on the render thread; the compiles touch nothing but their own entry.
+class PipelineLibrary {
+public:
+    using BuildFunction = std::function<VkPipeline(const PipelineDescription&)>;
+
+    PipelineLibrary(VkDevice device, JobSystem& jobs, BuildFunction build)
+        : device(device), jobs(jobs), build(std::move(build)) {}
+
+    PipelineHandle add(const PipelineDescription& description, PipelineHandle fallback = INVALID_PIPELINE_HANDLE) {
+        PipelineHandle handle = static_cast<PipelineHandle>(entries.size());
+        entries.emplace_back();
+
+        Entry& entry = entries.back();
+        entry.description = description;
+        entry.fallback = fallback;
+
+        jobs.submit([this, &entry] { compile(entry); }, compiles);
+
+        return handle;
+    }
+
+    // returns the pipeline if compiled, otherwise the fallback chain, otherwise VK_NULL_HANDLE
+    VkPipeline get(PipelineHandle handle) const {
+        while (handle != INVALID_PIPELINE_HANDLE) {
+            const Entry& entry = entries[handle];
+            if (entry.state.load(std::memory_order_acquire) == State::Ready) {
+                return entry.pipeline;
+            }
+            handle = entry.fallback;
+        }
+
+        return VK_NULL_HANDLE;
+    }
+
+    uint32_t size() const {
+        return static_cast<uint32_t>(entries.size());
+    }
+
+    bool isReady(PipelineHandle handle) const {
+        return entries[handle].state.load(std::memory_order_acquire) == State::Ready;
+    }
+
+    // the first build failed and no reload has replaced it yet
+    bool isFailed(PipelineHandle handle) const {
+        return entries[handle].state.load(std::memory_order_acquire) == State::Failed;
+    }
+
+    // recompiles every pipeline that uses the given SPIR-V file; the results wait in swapPending()
+    void reloadShader(const std::string& spirvPath) {
+        for (auto& entry : entries) {
+            if (entry.description.vertShader == spirvPath || entry.description.fragShader == spirvPath) {
+                jobs.submit([this, &entry] { recompile(entry); }, compiles);
+            }
+        }
+    }
+
+    // installs recompiled pipelines; the replaced ones go to retire() because frames in flight may still use them
+    void swapPending(const std::function<void(VkPipeline)>& retire) {
+        for (auto& entry : entries) {
+            if (entry.state.load(std::memory_order_acquire) == State::Compiling) {
+                continue;
+            }
+
+            VkPipeline pending = entry.pending.exchange(VK_NULL_HANDLE, std::memory_order_acq_rel);
+            if (pending == VK_NULL_HANDLE) {
+                continue;
+            }
+
+            if (entry.pipeline != VK_NULL_HANDLE) {
+                retire(entry.pipeline);
+            }
+            entry.pipeline = pending;
+            entry.state.store(State::Ready, std::memory_order_release);
+        }
+    }
+
+    void waitIdle() {
+        jobs.wait(compiles);
+    }
+
+    void destroy() {
+        waitIdle();
+
+        for (auto& entry : entries) {
+            if (entry.pipeline != VK_NULL_HANDLE) {
+                vkDestroyPipeline(device, entry.pipeline, nullptr);
+            }
+            if (entry.pending != VK_NULL_HANDLE) {
+                vkDestroyPipeline(device, entry.pending, nullptr);
+            }
+        }
+        entries.clear();
+    }
+
+private:
+    enum class State { Compiling, Ready, Failed };
+
+    struct Entry {
+        PipelineDescription description;
+        PipelineHandle fallback = INVALID_PIPELINE_HANDLE;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        std::atomic<VkPipeline> pending{VK_NULL_HANDLE};
+        std::atomic<State> state{State::Compiling};
+    };
+
+    VkDevice device;
+    JobSystem& jobs;
+    TaskCounter compiles;
+    BuildFunction build;
+    std::deque<Entry> entries;
+
+    void compile(Entry& entry) {
+        try {
+            entry.pipeline = build(entry.description);
+            entry.state.store(State::Ready, std::memory_order_release);
+            Telemetry::instance().add(Telemetry::PipelinesCompiled);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << " (" << entry.description.vertShader << ", " << entry.description.fragShader << ")" << std::endl;
+            entry.state.store(State::Failed, std::memory_order_release);
+        }
+    }
+
+    void recompile(Entry& entry) {
+        try {
+            VkPipeline replaced = entry.pending.exchange(build(entry.description), std::memory_order_acq_rel);
+            Telemetry::instance().add(Telemetry::PipelinesCompiled);
+            if (replaced != VK_NULL_HANDLE) {
+                // superseded before it was ever bound
+                vkDestroyPipeline(device, replaced, nullptr);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << " (" << entry.description.vertShader << ", " << entry.description.fragShader << ")" << std::endl;
+        }
+    }
+};
+
+// Polls GLSL sources from background tasks and rebuilds their SPIR-V with glslc when they change. The render
+// thread starts a poll with update() and collects the rebuilt SPIR-V paths with takeCompiled() to reload the
+// affected pipelines.
+class ShaderWatcher {
+public:
+    ~ShaderWatcher() {
+        stop();
+    }
+
+    void watch(const std::string& source, const std::string& spirv) {
+        for (const auto& shader : shaders) {
+            if (shader.source == source) {
+                return;
+            }
+        }
+
+        std::error_code error;
+        shaders.push_back({source, spirv, std::filesystem::last_write_time(source, error)});
+    }
+
+    void start(JobSystem& jobSystem) {
+        jobs = &jobSystem;
+        running = true;
+    }
+
+    // at most one poll in flight, and no more often than POLL_INTERVAL
+    void update() {
+        auto now = std::chrono::steady_clock::now();
+        if (!running || !polls.done() || now - lastPoll < POLL_INTERVAL) {
+            return;
+        }
+        lastPoll = now;
+
+        jobs->submit([this] { poll(); }, polls);
+    }
+
+    void stop() {
+        running = false;
+        if (jobs) {
+            jobs->wait(polls);
+        }
+    }
+
+    std::vector<std::string> takeCompiled() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::move(compiled);
+    }
+
+private:
+    struct WatchedShader {
+        std::string source;
+        std::string spirv;
+        std::filesystem::file_time_type lastWrite;
+    };
+
+    static constexpr std::chrono::milliseconds POLL_INTERVAL{250};
+
+    std::vector<WatchedShader> shaders;
+    JobSystem* jobs = nullptr;
+    TaskCounter polls;
+    std::chrono::steady_clock::time_point lastPoll;
+    std::atomic<bool> running{false};
+    std::mutex mutex;
+    std::vector<std::string> compiled;
+
+    void poll() {
+        for (auto& shader : shaders) {
+            if (!running) {
+                return;
+            }
+
+            std::error_code error;
+            auto lastWrite = std::filesystem::last_write_time(shader.source, error);
+            if (error || lastWrite == shader.lastWrite) {
+                continue;
+            }
+            shader.lastWrite = lastWrite;
+
+            TRACE_SCOPE("compile shader");
+            if (compile(shader.source, shader.spirv)) {
+                std::lock_guard<std::mutex> lock(mutex);
+                compiled.push_back(shader.spirv);
+            }
+        }
+    }
+
+    // compiles next to the target and renames it into place so a reader never maps a half-written file
+    static bool compile(const std::string& source, const std::string& spirv) {
+        std::string tempPath = spirv + ".tmp";
+        std::string command = "\"" + glslcPath() + "\" \"" + source + "\" -o \"" + tempPath + "\"";
+
+        std::error_code error;
+        if (std::system(command.c_str()) != 0) {
+            std::filesystem::remove(tempPath, error);
+            std::cerr << "failed to compile shader " << source << "!" << std::endl;
+            return false;
+        }
+
+        std::filesystem::rename(tempPath, spirv, error);
+        if (error) {
+            std::cerr << "failed to replace " << spirv << ": " << error.message() << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    static std::string glslcPath() {
+        if (const char* glslc = std::getenv("GLSLC")) {
+            return glslc;
+        }
+        if (const char* sdk = std::getenv("VULKAN_SDK")) {
+            return (std::filesystem::path(sdk) / "bin" / "glslc").string();
+        }
+        return "glslc";
+    }
+};
+
+// GPU time per named region, measured with timestamp queries. Each frame slot has its own query pool,
+// which is only read back once that slot's frame has retired, so collecting never waits on the GPU.
+class GpuProfiler {
+public:
+    struct RegionStats {
+        double minMs;
+        double averageMs;
+        double p99Ms;
+        size_t samples;
+    };
+
+    static const uint32_t MAX_REGIONS_PER_FRAME = 64;
+    static const size_t HISTORY_LENGTH = 240;
+    static const uint32_t INVALID_REGION = UINT32_MAX;
+
+    // timestampValidBits comes from the queue family the timestamps are written on; 0 means no timestamp support
+    GpuProfiler(VkDevice device, float timestampPeriod, uint32_t timestampValidBits, uint32_t frameCount)
+        : device(device), nanosecondsPerTick(timestampPeriod) {
+        if (timestampValidBits == 0) {
+            std::cerr << "timestamp queries are not supported, GPU profiling is disabled!" << std::endl;
+            return;
+        }
+        timestampMask = timestampValidBits >= 64 ? UINT64_MAX : (uint64_t(1) << timestampValidBits) - 1;
+
+        frames.resize(frameCount);
+        for (auto& frame : frames) {
+            VkQueryPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            poolInfo.queryCount = MAX_REGIONS_PER_FRAME * 2;
+
+            if (vkCreateQueryPool(device, &poolInfo, nullptr, &frame.queryPool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create timestamp query pool!");
+            }
+            frame.regionNames.reserve(MAX_REGIONS_PER_FRAME);
+        }
+    }
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    // call once the slot's frame has retired, before recording into it again; returns whether the frame
+    // added samples
+    bool collect(uint32_t frameIndex) {
+        if (frames.empty() || !frames[frameIndex].submitted) {
+            return false;
+        }
+
+        FrameQueries& frame = frames[frameIndex];
+        frame.submitted = false;
+
+        uint32_t queryCount = static_cast<uint32_t>(frame.regionNames.size()) * 2;
+        if (queryCount == 0) {
+            return false;
+        }
+
+        // no WAIT_BIT: once the frame has retired the results are available, and if a driver disagrees we drop the frame
+        results.resize(queryCount);
+        VkResult result = vkGetQueryPoolResults(device, frame.queryPool, 0, queryCount, results.size() * sizeof(uint64_t),
+            results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result != VK_SUCCESS) {
+            return false;
+        }
+
+        for (size_t i = 0; i < frame.regionNames.size(); i++) {
+            uint64_t ticks = (results[i * 2 + 1] - results[i * 2]) & timestampMask;
+            addSample(frame.regionNames[i], ticks * nanosecondsPerTick / 1e6);
+        }
+
+        if (Tracer::instance().isEnabled()) {
+            traceFrame(frame);
+        }
+        return true;
+    }
+
+    // the most recent sample of a region, if it has any
+    std::optional<double> latest(const std::string& name) const {
+        auto found = histories.find(name);
+        if (found == histories.end() || found->second.samples.empty()) {
+            return std::nullopt;
+        }
+
+        const History& history = found->second;
+        size_t newest = history.samples.size() < HISTORY_LENGTH ? history.samples.size() - 1 : (history.next + HISTORY_LENGTH - 1) % HISTORY_LENGTH;
+        return history.samples[newest];
+    }
+
+    // resets the slot's queries; must be recorded outside of a render pass
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+        if (frames.empty()) {
+            return;
+        }
+
+        recordingFrame = frameIndex;
+        FrameQueries& frame = frames[frameIndex];
+        frame.regionNames.clear();
+        frame.submitted = true;
+        frame.recordedNs = Tracer::nowNs();
+
+        vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, MAX_REGIONS_PER_FRAME * 2);
+    }
+
+    // name must outlive the frame, in practice a string literal
+    uint32_t beginRegion(VkCommandBuffer commandBuffer, const char* name) {
+        if (frames.empty() || frames[recordingFrame].regionNames.size() == MAX_REGIONS_PER_FRAME) {
+            return INVALID_REGION;
+        }
+
+        FrameQueries& frame = frames[recordingFrame];
+        uint32_t region = static_cast<uint32_t>(frame.regionNames.size());
+        frame.regionNames.push_back(name);
+
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.queryPool, region * 2);
+        return region;
+    }
+
+    void endRegion(VkCommandBuffer commandBuffer, uint32_t region) {
+        if (region == INVALID_REGION) {
+            return;
+        }
+
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frames[recordingFrame].queryPool, region * 2 + 1);
+    }
+
+    // rolling statistics over the last HISTORY_LENGTH samples of each region
+    std::map<std::string, RegionStats> stats() const {
+        std::map<std::string, RegionStats> regionStats;
+
+        for (const auto& [name, history] : histories) {
+            std::vector<double> sorted = history.samples;
+            std::sort(sorted.begin(), sorted.end());
+
+            double total = 0.0;
+            for (double sample : sorted) {
+                total += sample;
+            }
+
+            size_t p99Index = std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * 0.99));
+            regionStats[name] = {sorted.front(), total / sorted.size(), sorted[p99Index], sorted.size()};
+        }
+
+        return regionStats;
+    }
+
+    void destroy() {
+        for (auto& frame : frames) {
+            vkDestroyQueryPool(device, frame.queryPool, nullptr);
+        }
+        frames.clear();
+    }
+
+private:
+    struct FrameQueries {
+        VkQueryPool queryPool = VK_NULL_HANDLE;
+        std::vector<const char*> regionNames;
+        bool submitted = false;
+        int64_t recordedNs = 0;
+    };
+
+    struct History {
+        std::vector<double> samples;
+        size_t next = 0;
+    };
+
+    VkDevice device;
+    double nanosecondsPerTick;
+    uint64_t timestampMask = UINT64_MAX;
+    std::vector<FrameQueries> frames;
+    uint32_t recordingFrame = 0;
+    std::vector<uint64_t> results;
+    std::map<std::string, History> histories;
+    int64_t lastTracedEndNs = 0;
+
+    // the GPU clock has no fixed relation to the CPU one, so each frame is placed where it could have started
+    // at the earliest: after it was recorded and after the previous frame's GPU work
+    void traceFrame(const FrameQueries& frame) {
+        int64_t anchorNs = std::max(frame.recordedNs, lastTracedEndNs);
+        uint64_t firstTick = results[0];
+
+        for (size_t i = 0; i < frame.regionNames.size(); i++) {
+            int64_t startNs = anchorNs + static_cast<int64_t>(((results[i * 2] - firstTick) & timestampMask) * nanosecondsPerTick);
+            int64_t durationNs = static_cast<int64_t>(((results[i * 2 + 1] - results[i * 2]) & timestampMask) * nanosecondsPerTick);
+            Tracer::instance().recordGpu(frame.regionNames[i], startNs, durationNs);
+            lastTracedEndNs = std::max(lastTracedEndNs, startNs + durationNs);
+        }
+    }
+
+    void addSample(const char* name, double milliseconds) {
+        History& history = histories[name];
+        if (history.samples.size() < HISTORY_LENGTH) {
+            history.samples.push_back(milliseconds);
+        } else {
+            history.samples[history.next] = milliseconds;
+            history.next = (history.next + 1) % HISTORY_LENGTH;
+        }
+    }
+};
+
+class GpuProfileScope {
+public:
+    GpuProfileScope(GpuProfiler* profiler, VkCommandBuffer commandBuffer, const char* name)
+        : profiler(profiler), commandBuffer(commandBuffer),
+          region(profiler ? profiler->beginRegion(commandBuffer, name) : GpuProfiler::INVALID_REGION) {}
+
+    ~GpuProfileScope() {
+        if (profiler) {
+            profiler->endRegion(commandBuffer, region);
+        }
+    }
+
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+private:
+    GpuProfiler* profiler;
+    VkCommandBuffer commandBuffer;
+    uint32_t region;
+};
+
+// times the rest of the enclosing block on the GPU; compiled out in release builds
+#ifdef NDEBUG
+#define GPU_PROFILE_SCOPE(profiler, commandBuffer, name)
+#else
+#define GPU_PROFILE_SCOPE(profiler, commandBuffer, name) \
+    GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(profiler, commandBuffer, name)
+#endif
+
+// Sub-allocates buffers and images out of a few large VkDeviceMemory blocks instead of one allocation per
+// resource. Requests are rounded up to a power-of-two size class and served from a pool of blocks
+// dedicated to that class, memory type and (because of bufferImageGranularity) linear vs. optimal
+// tiling, so allocating and freeing is a free-list push or pop. Requests too large for a class get their
+// own allocation.
+class DeviceAllocator {
+public:
+    struct MemoryTypeStats {
+        uint32_t deviceAllocations = 0;
+        uint32_t liveAllocations = 0;
+        VkDeviceSize reservedBytes = 0;
+        VkDeviceSize usedBytes = 0;
+    };
+
+    static const VkDeviceSize MIN_SIZE_CLASS = 256;
+    static const VkDeviceSize MIN_BLOCK_SIZE = 1 << 20;
+    static const VkDeviceSize MAX_BLOCK_SIZE = 64 << 20;
+    static const uint32_t DEDICATED = UINT32_MAX - 1;
+
+    DeviceAllocator(VkPhysicalDevice physicalDevice, VkDevice device) : device(device) {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+        maxMemoryAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+        statsByType.resize(memoryProperties.memoryTypeCount);
+    }
+
+    DeviceAllocator(const DeviceAllocator&) = delete;
+    DeviceAllocator& operator=(const DeviceAllocator&) = delete;
+
+    // the first type that has preferred on top of required, otherwise the first that has required
+    std::optional<uint32_t> findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) const {
+        for (VkMemoryPropertyFlags properties : {required | preferred, required}) {
+            for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+                if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                    return i;
+                }
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    MemoryAllocation allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) {
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+        MemoryAllocation allocation = allocate(memRequirements, required, preferred, true);
+        vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+        return allocation;
+    }
+
+    MemoryAllocation allocateForImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) {
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+        MemoryAllocation allocation = allocate(memRequirements, required, preferred, tiling == VK_IMAGE_TILING_LINEAR);
+        vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+        return allocation;
+    }
+
+    MemoryAllocation allocate(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, bool linear) {
+        std::optional<uint32_t> memoryType = findMemoryType(memRequirements.memoryTypeBits, required, preferred);
+        if (!memoryType) {
+            throw std::runtime_error("failed to find suitable memory type!");
+        }
+
+        // slots are aligned to their own size, which covers any (power-of-two) alignment up to it
+        VkDeviceSize sizeClass = std::max({MIN_SIZE_CLASS, nonCoherentAtomSize, memRequirements.alignment});
+        while (sizeClass < memRequirements.size) {
+            sizeClass *= 2;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        MemoryAllocation allocation;
+        if (sizeClass > MAX_BLOCK_SIZE / 4) {
+            allocation.memory = allocateDeviceMemory(memoryType.value(), memRequirements.size, allocation.data);
+            allocation.size = memRequirements.size;
+            allocation.pool = DEDICATED;
+            statsByType[memoryType.value()].reservedBytes += memRequirements.size;
+        } else {
+            uint32_t poolIndex = findPool(memoryType.value(), linear, sizeClass);
+            Pool& pool = pools[poolIndex];
+
+            auto block = std::find_if(pool.blocks.begin(), pool.blocks.end(), [](const Block& block) { return !block.freeSlots.empty(); });
+            if (block == pool.blocks.end()) {
+                pool.blocks.push_back(createBlock(pool));
+                block = std::prev(pool.blocks.end());
+            }
+
+            allocation.slot = block->freeSlots.back();
+            block->freeSlots.pop_back();
+            allocation.memory = block->memory;
+            allocation.offset = allocation.slot * pool.sizeClass;
+            allocation.size = memRequirements.size;
+            allocation.data = block->data != nullptr ? static_cast<char*>(block->data) + allocation.offset : nullptr;
+            allocation.pool = poolIndex;
+            allocation.block = static_cast<uint32_t>(block - pool.blocks.begin());
+        }
+
+        allocation.memoryType = memoryType.value();
+
+        MemoryTypeStats& stats = statsByType[allocation.memoryType];
+        stats.liveAllocations++;
+        stats.usedBytes += allocation.size;
+
+        return allocation;
+    }
+
+    void free(MemoryAllocation& allocation) {
+        if (allocation.memory == VK_NULL_HANDLE) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        MemoryTypeStats& stats = statsByType[allocation.memoryType];
+        stats.liveAllocations--;
+        stats.usedBytes -= allocation.size;
+
+        if (allocation.pool == DEDICATED) {
+            stats.deviceAllocations--;
+            stats.reservedBytes -= allocation.size;
+            vkFreeMemory(device, allocation.memory, nullptr);
+        } else {
+            // blocks are kept when they empty out, so a resource that is recreated every frame never reaches vkAllocateMemory
+            pools[allocation.pool].blocks[allocation.block].freeSlots.push_back(allocation.slot);
+        }
+
+        allocation = MemoryAllocation{};
+    }
+
+    std::vector<MemoryTypeStats> stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return statsByType;
+    }
+
+    void printStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t deviceAllocations = 0;
+        for (uint32_t i = 0; i < statsByType.size(); i++) {
+            const MemoryTypeStats& stats = statsByType[i];
+            if (stats.deviceAllocations == 0) {
+                continue;
+            }
+
+            deviceAllocations += stats.deviceAllocations;
+            std::cout << "memory type " << i << ": " << stats.liveAllocations << " allocations using " << stats.usedBytes / 1024
+                << " KiB of " << stats.reservedBytes / 1024 << " KiB in " << stats.deviceAllocations << " device allocations" << std::endl;
+        }
+
+        std::cout << "device memory allocations: " << deviceAllocations << " of " << maxMemoryAllocationCount << std::endl;
+    }
+
+    void destroy() {
+        for (auto& pool : pools) {
+            for (auto& block : pool.blocks) {
+                vkFreeMemory(device, block.memory, nullptr);
+            }
+        }
+        pools.clear();
+        poolIndices.clear();
+    }
+
+private:
+    struct Block {
+        VkDeviceMemory memory;
+        void* data;
+        std::vector<uint32_t> freeSlots;
+    };
+
+    struct Pool {
+        uint32_t memoryType;
+        VkDeviceSize sizeClass;
+        VkDeviceSize blockSize;
+        std::vector<Block> blocks;
+    };
+
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDeviceSize nonCoherentAtomSize;
+    uint32_t maxMemoryAllocationCount;
+
+    mutable std::mutex mutex;
+    std::vector<Pool> pools;
+    std::map<std::tuple<uint32_t, bool, VkDeviceSize>, uint32_t> poolIndices;
+    std::vector<MemoryTypeStats> statsByType;
+
+    uint32_t findPool(uint32_t memoryType, bool linear, VkDeviceSize sizeClass) {
+        auto key = std::make_tuple(memoryType, linear, sizeClass);
+        auto existing = poolIndices.find(key);
+        if (existing != poolIndices.end()) {
+            return existing->second;
+        }
+
+        // small heaps (e.g. the 256 MiB host-visible device-local one) get proportionally smaller blocks
+        VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+        VkDeviceSize blockSize = std::clamp(sizeClass * 64, MIN_BLOCK_SIZE, std::max(MIN_BLOCK_SIZE, std::min(MAX_BLOCK_SIZE, heapSize / 8)));
+
+        uint32_t poolIndex = static_cast<uint32_t>(pools.size());
+        pools.push_back({memoryType, sizeClass, std::max(blockSize, sizeClass), {}});
+        poolIndices[key] = poolIndex;
+        return poolIndex;
+    }
+
+    Block createBlock(const Pool& pool) {
+        Block block{};
+        block.memory = allocateDeviceMemory(pool.memoryType, pool.blockSize, block.data);
+        statsByType[pool.memoryType].reservedBytes += pool.blockSize;
+
+        uint32_t slotCount = static_cast<uint32_t>(pool.blockSize / pool.sizeClass);
+        for (uint32_t slot = slotCount; slot > 0; slot--) {
+            block.freeSlots.push_back(slot - 1);
+        }
+
+        return block;
+    }
+
+    VkDeviceMemory allocateDeviceMemory(uint32_t memoryType, VkDeviceSize size, void*& data) {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryType;
+
+        VkDeviceMemory memory;
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate device memory!");
+        }
+        statsByType[memoryType].deviceAllocations++;
+
+        data = nullptr;
+        if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data);
+        }
+
+        return memory;
+    }
+};
+
+// One timeline semaphore per queue. A submit signals the next value, so asking whether submit N has
+// finished is a counter read, and waiting for it takes no fence that would need resetting.
+class QueueTimeline {
+public:
+    void create(VkDevice device, const char* name) {
+        this->device = device;
+
+        VkSemaphoreTypeCreateInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        timelineInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &timelineInfo;
+
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS) {
+            throw std::runtime_error(std::string("failed to create ") + name + " timeline semaphore!");
+        }
+    }
+
+    void destroy() {
+        vkDestroySemaphore(device, timeline, nullptr);
+    }
+
+    VkSemaphore semaphore() const {
+        return timeline;
+    }
+
+    uint64_t completedValue() const {
+        uint64_t value = 0;
+        vkGetSemaphoreCounterValue(device, timeline, &value);
+        return value;
+    }
+
+    void wait(uint64_t value) const {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &value;
+        vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+    }
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    VkSemaphore timeline = VK_NULL_HANDLE;
+};
+
+// Destroys GPU objects once the GPU is done with them. Each entry is tagged with the serial of the last
+// frame that may still use its object and runs from flush() once that frame has completed. Entries are
+// expected in serial order; one tagged out of order only waits behind the newer ones before it.
+class DeletionQueue {
+public:
+    void push(uint64_t lastUsedSerial, std::function<void()> destroy) {
+        entries.push_back({lastUsedSerial, std::move(destroy)});
+    }
+
+    void flush(uint64_t completedSerial) {
+        while (!entries.empty() && entries.front().lastUsedSerial <= completedSerial) {
+            // popped first, so a destroy that pushes more entries cannot invalidate the one running
+            std::function<void()> destroy = std::move(entries.front().destroy);
+            entries.pop_front();
+            destroy();
+        }
+    }
+
+    // only once the device is idle
+    void flushAll() {
+        flush(std::numeric_limits<uint64_t>::max());
+    }
+
+private:
+    struct Entry {
+        uint64_t lastUsedSerial;
+        std::function<void()> destroy;
+    };
+    std::deque<Entry> entries;
+};
+
+// One descriptor set of storage buffers shared by every pipeline, bound once per command buffer; shaders
+// pick a buffer by the index a push constant carries rather than by which set is bound. The array is
+// partially bound and slots are written one at a time as buffers are added, which descriptor indexing
+// allows while frames in flight use the set so long as they do not use the slot being written.
+class BindlessDescriptors {
+public:
+    static const uint32_t MAX_BUFFERS = 4096;
+
+    void create(VkDevice device, uint32_t capacity) {
+        this->device = device;
+        this->capacity = capacity;
+
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        binding.descriptorCount = capacity;
+        binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        bindingFlagsInfo.bindingCount = 1;
+        bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext = &bindingFlagsInfo;
+        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &binding;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create bindless descriptor set layout!");
+        }
+
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSize.descriptorCount = capacity;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
+
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create bindless descriptor pool!");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &setLayout;
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate bindless descriptor set!");
+        }
+    }
+
+    void destroy() {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+        vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+    }
+
+    VkDescriptorSetLayout layout() const {
+        return setLayout;
+    }
+
+    VkDescriptorSet set() const {
+        return descriptorSet;
+    }
+
+    // the index shaders use to reach the buffer
+    uint32_t addBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE) {
+        if (count == capacity) {
+            throw std::runtime_error("out of bindless descriptors!");
+        }
+
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = buffer;
+        bufferInfo.offset = offset;
+        bufferInfo.range = range;
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptorSet;
+        write.dstBinding = 0;
+        write.dstArrayElement = count;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.descriptorCount = 1;
+        write.pBufferInfo = &bufferInfo;
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+        return count++;
+    }
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    uint32_t capacity = 0;
+    uint32_t count = 0;
+};
+
+// A host-visible buffer handed out front to back for data that lives until the frame that wrote it
+// completes, e.g. staging uploads. Each span is tagged with its frame's serial, and release() reclaims
+// everything up to the last completed one, so it never waits on the GPU.
+class RingArena {
+public:
+    struct Span {
+        VkBuffer buffer;
+        VkDeviceSize offset;
+        void* data;
+    };
+
+    void create(VkDevice device, DeviceAllocator& allocator, VkDeviceSize capacity, VkBufferUsageFlags usage) {
+        this->device = device;
+        this->allocator = &allocator;
+        this->capacity = capacity;
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = capacity;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create ring buffer!");
+        }
+
+        allocation = allocator.allocateForBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+
+    // nullopt when the ring is full until more frames complete
+    std::optional<Span> allocate(VkDeviceSize size, VkDeviceSize alignment, uint64_t serial) {
+        if (regions.empty()) {
+            head = 0;
+        }
+
+        VkDeviceSize offset = (head + alignment - 1) / alignment * alignment;
+        if (regions.empty()) {
+            if (size > capacity) {
+                return std::nullopt;
+            }
+        } else if (head > regions.front().begin) {
+            // free space is [head, capacity) followed by [0, tail)
+            if (offset + size > capacity) {
+                offset = 0;
+                if (size > regions.front().begin) {
+                    return std::nullopt;
+                }
+            }
+        } else if (offset + size > regions.front().begin) {
+            return std::nullopt;
+        }
+
+        if (!regions.empty() && regions.back().serial == serial && regions.back().end == offset) {
+            regions.back().end = offset + size;
+        } else {
+            regions.push_back({offset, offset + size, serial});
+        }
+        head = offset + size;
+
+        return Span{buffer, offset, static_cast<char*>(allocation.data) + offset};
+    }
+
+    void release(uint64_t completedSerial) {
+        while (!regions.empty() && regions.front().serial <= completedSerial) {
+            regions.pop_front();
+        }
+    }
+
+    VkDeviceSize bytesInUse() const {
+        if (regions.empty()) {
+            return 0;
+        }
+
+        VkDeviceSize tail = regions.front().begin;
+        return head > tail ? head - tail : capacity - tail + head;
+    }
+
+    void destroy() {
+        if (buffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, buffer, nullptr);
+            allocator->free(allocation);
+            buffer = VK_NULL_HANDLE;
+        }
+    }
+
+private:
+    struct Region {
+        VkDeviceSize begin;
+        VkDeviceSize end;
+        uint64_t serial;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    DeviceAllocator* allocator = nullptr;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    MemoryAllocation allocation;
+    VkDeviceSize capacity = 0;
+    VkDeviceSize head = 0;
+    std::deque<Region> regions;
+};
+
+// Copies data into device-local buffers through a persistently mapped staging ring, on the transfer queue.
+// Each flush() submits the copies recorded since the last one and signals the next value of a timeline
+// semaphore; whoever reads the data waits for that value on the GPU, so the CPU never waits for an upload
+// unless the staging ring runs full. upload() may be called from any thread, e.g. a streaming loader.
+class UploadQueue {
+public:
+    static const VkDeviceSize STAGING_SIZE = 8 << 20;
+
+    // queueMutex guards every submission to queue, which rendering may be submitting to as well
+    void create(VkDevice device, DeviceAllocator& allocator, VkQueue queue, uint32_t queueFamily, std::mutex& queueMutex) {
+        this->device = device;
+        this->queue = queue;
+        this->queueMutex = &queueMutex;
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamily;
+
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload command pool!");
+        }
+
+        timeline.create(device, "upload");
+
+        staging.create(device, allocator, STAGING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    }
+
+    // records a copy into dst; the data is consumed before upload() returns
+    void upload(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size) {
+        const char* bytes = static_cast<const char*>(data);
+        Telemetry::instance().add(Telemetry::BytesUploaded, size);
+
+        // big uploads go through in pieces so they never need more than part of the ring
+        while (size > 0) {
+            VkDeviceSize pieceSize = std::min(size, STAGING_SIZE / 4);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            std::optional<RingArena::Span> span = staging.allocate(pieceSize, 16, submittedValue + 1);
+            while (!span) {
+                flushLocked();
+                waitForOldest(lock);
+                span = staging.allocate(pieceSize, 16, submittedValue + 1);
+            }
+
+            memcpy(span->data, bytes, pieceSize);
+
+            VkBufferCopy copyRegion{};
+            copyRegion.srcOffset = span->offset;
+            copyRegion.dstOffset = dstOffset;
+            copyRegion.size = pieceSize;
+            vkCmdCopyBuffer(recordingCommandBuffer(), span->buffer, dst, 1, &copyRegion);
+
+            bytes += pieceSize;
+            dstOffset += pieceSize;
+            size -= pieceSize;
+        }
+    }
+
+    // submits everything recorded so far; returns the timeline value that signals when it has landed
+    uint64_t flush() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return flushLocked();
+    }
+
+    VkSemaphore semaphore() const {
+        return timeline.semaphore();
+    }
+
+    void destroy() {
+        {
+            std::lock_guard<std::mutex> lock(*queueMutex);
+            vkQueueWaitIdle(queue);
+        }
+
+        staging.destroy();
+        timeline.destroy();
+        vkDestroyCommandPool(device, commandPool, nullptr);
+    }
+
+private:
+    struct InFlightUpload {
+        VkCommandBuffer commandBuffer;
+        uint64_t value;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue queue = VK_NULL_HANDLE;
+    std::mutex* queueMutex = nullptr;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    QueueTimeline timeline;
+    RingArena staging;
+
+    std::mutex mutex;
+    uint64_t submittedValue = 0;
+    VkCommandBuffer recording = VK_NULL_HANDLE;
+    std::deque<InFlightUpload> inFlight;
+    std::vector<VkCommandBuffer> freeCommandBuffers;
+
+    uint64_t flushLocked() {
+        retire();
+
+        if (recording == VK_NULL_HANDLE) {
+            return submittedValue;
+        }
+
+        if (vkEndCommandBuffer(recording) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record upload command buffer!");
+        }
+
+        uint64_t signalValue = submittedValue + 1;
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &recording;
+        VkSemaphore signalSemaphore = timeline.semaphore();
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &signalSemaphore;
+
+        {
+            std::lock_guard<std::mutex> queueLock(*queueMutex);
+            if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit upload command buffer!");
+            }
+        }
+
+        submittedValue = signalValue;
+        inFlight.push_back({recording, submittedValue});
+        recording = VK_NULL_HANDLE;
+
+        return submittedValue;
+    }
+
+    VkCommandBuffer recordingCommandBuffer() {
+        if (recording != VK_NULL_HANDLE) {
+            return recording;
+        }
+
+        if (freeCommandBuffers.empty()) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(device, &allocInfo, &recording) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate upload command buffer!");
+            }
+        } else {
+            recording = freeCommandBuffers.back();
+            freeCommandBuffers.pop_back();
+            vkResetCommandBuffer(recording, 0);
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(recording, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording upload command buffer!");
+        }
+
+        return recording;
+    }
+
+    // recycles the command buffers and staging space of every upload that has landed
+    void retire() {
+        uint64_t completedValue = timeline.completedValue();
+
+        while (!inFlight.empty() && inFlight.front().value <= completedValue) {
+            freeCommandBuffers.push_back(inFlight.front().commandBuffer);
+            inFlight.pop_front();
+        }
+        staging.release(completedValue);
+    }
+
+    // drops the lock while waiting so other threads can keep flushing
+    void waitForOldest(std::unique_lock<std::mutex>& lock) {
+        if (inFlight.empty()) {
+            throw std::runtime_error("failed to fit upload into staging buffer!");
+        }
+        uint64_t oldestValue = inFlight.front().value;
+
+        lock.unlock();
+        timeline.wait(oldestValue);
+        lock.lock();
+
+        retire();
+    }
+};
+
+// Streams a memory-mapped .mesh file to the GPU as background tasks, a few meshlets at a time, so the
+// first frame never waits for the whole file. drawableIndexCount() only ever covers complete meshlets
+// whose vertices and indices have been handed to the upload queue.
+class MeshStreamer {
+public:
+    static const VkDeviceSize CHUNK_SIZE = 1 << 20;
+
+    // validates the header only; the rest of the file is not touched until start()
+    void open(MappedFile mappedFile) {
+        file = std::move(mappedFile);
+
+        if (file.size() < sizeof(MeshFileHeader)) {
+            throw std::runtime_error("failed to load mesh: file is too small!");
+        }
+        memcpy(&fileHeader, file.data(), sizeof(MeshFileHeader));
+
+        if (memcmp(fileHeader.magic, MESH_FILE_MAGIC, sizeof(MESH_FILE_MAGIC)) != 0 || fileHeader.version != MESH_FILE_VERSION) {
+            throw std::runtime_error("failed to load mesh: not a version 1 mesh file!");
+        }
+        if ((fileHeader.indexSize != 2 && fileHeader.indexSize != 4) || fileHeader.meshletCount == 0) {
+            throw std::runtime_error("failed to load mesh: invalid header!");
+        }
+        if (!fits(fileHeader.vertexOffset, uint64_t(fileHeader.vertexCount) * sizeof(PackedVertex)) ||
+            !fits(fileHeader.indexOffset, uint64_t(fileHeader.indexCount) * fileHeader.indexSize) ||
+            !fits(fileHeader.meshletOffset, uint64_t(fileHeader.meshletCount) * sizeof(Meshlet))) {
+            throw std::runtime_error("failed to load mesh: file is truncated!");
+        }
+        if (fileHeader.vertexOffset % alignof(PackedVertex) != 0 || fileHeader.indexOffset % fileHeader.indexSize != 0 ||
+            fileHeader.meshletOffset % alignof(Meshlet) != 0) {
+            throw std::runtime_error("failed to load mesh: misaligned sections!");
+        }
+    }
+
+    const MeshFileHeader& header() const {
+        return fileHeader;
+    }
+
+    VkIndexType indexType() const {
+        return fileHeader.indexSize == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    }
+
+    // streams one chunk per background task, so a long mesh leaves room for other background work in between
+    void start(JobSystem& jobSystem, UploadQueue& uploadQueue, VkBuffer vertexBuffer, VkBuffer indexBuffer) {
+        jobs = &jobSystem;
+        uploads = &uploadQueue;
+        vertices = vertexBuffer;
+        indices = indexBuffer;
+        stopping = false;
+        uploadedVertices = 0;
+        uploadedIndices = 0;
+        meshlet = 0;
+
+        jobs->submit([this] { streamChunk(); }, chunks);
+    }
+
+    uint32_t drawableIndexCount() const {
+        return residentIndexCount.load(std::memory_order_acquire);
+    }
+
+    void stop() {
+        stopping = true;
+        if (jobs) {
+            jobs->wait(chunks);
+        }
+    }
+
+private:
+    MappedFile file;
+    MeshFileHeader fileHeader{};
+    JobSystem* jobs = nullptr;
+    UploadQueue* uploads = nullptr;
+    VkBuffer vertices = VK_NULL_HANDLE;
+    VkBuffer indices = VK_NULL_HANDLE;
+    TaskCounter chunks;
+    std::atomic<bool> stopping{false};
+    std::atomic<uint32_t> residentIndexCount{0};
+
+    // only touched by the chunk task in flight
+    uint32_t uploadedVertices = 0;
+    uint32_t uploadedIndices = 0;
+    uint32_t meshlet = 0;
+
+    bool fits(uint64_t offset, uint64_t size) const {
+        return offset <= file.size() && size <= file.size() - offset;
+    }
+
+    // a failed upload ends the stream; whatever made it in stays drawable
+    void streamChunk() {
+        try {
+            streamNextChunk();
+        } catch (const std::exception& e) {
+            std::cerr << "failed to stream mesh: " << e.what() << std::endl;
+        }
+    }
+
+    void streamNextChunk() {
+        if (meshlet >= fileHeader.meshletCount || stopping) {
+            return;
+        }
+
+        TRACE_SCOPE("stream mesh chunk");
+
+        const char* base = file.data();
+        const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(base + fileHeader.meshletOffset);
+
+        // gather meshlets until their indices fill a chunk
+        uint32_t indexEnd = uploadedIndices;
+        uint32_t vertexEnd = uploadedVertices;
+        while (meshlet < fileHeader.meshletCount && (indexEnd - uploadedIndices) * fileHeader.indexSize < CHUNK_SIZE) {
+            const Meshlet& next = meshlets[meshlet];
+            if (next.firstIndex != indexEnd || next.indexCount > fileHeader.indexCount - indexEnd ||
+                next.vertexEnd < vertexEnd || next.vertexEnd > fileHeader.vertexCount) {
+                std::cerr << "failed to stream mesh: meshlet " << meshlet << " is out of order!" << std::endl;
+                return;
+            }
+
+            indexEnd += next.indexCount;
+            vertexEnd = next.vertexEnd;
+            meshlet++;
+        }
+
+        if (vertexEnd > uploadedVertices) {
+            uploads->upload(vertices, uint64_t(uploadedVertices) * sizeof(PackedVertex),
+                base + fileHeader.vertexOffset + uint64_t(uploadedVertices) * sizeof(PackedVertex),
+                uint64_t(vertexEnd - uploadedVertices) * sizeof(PackedVertex));
+            uploadedVertices = vertexEnd;
+        }
+
+        uploads->upload(indices, uint64_t(uploadedIndices) * fileHeader.indexSize,
+            base + fileHeader.indexOffset + uint64_t(uploadedIndices) * fileHeader.indexSize,
+            uint64_t(indexEnd - uploadedIndices) * fileHeader.indexSize);
+        uploadedIndices = indexEnd;
+
+        // the copies are recorded, so the next flush() on the render thread covers them
+        residentIndexCount.store(uploadedIndices, std::memory_order_release);
+
+        // submitted before this task's count drops, so stop() waits for the next chunk too
+        if (meshlet < fileHeader.meshletCount) {
+            jobs->submit([this] { streamChunk(); }, chunks);
+        }
+    }
+};
+
+// Per-instance data as parallel arrays, so filling or updating one attribute is a contiguous loop the
+// compiler can vectorize. The instance SSBO uses the same layout: one column after another, each
+// instanceStride elements long (see shader.vert).
+struct InstanceData {
+    static const uint32_t COLUMN_COUNT = 5;
+
+    std::vector<float> positionX;
+    std::vector<float> positionY;
+    std::vector<float> scale;
+    std::vector<float> rotation;
+    std::vector<uint32_t> materialId;
+
+    size_t size() const {
+        return positionX.size();
+    }
+
+    void resize(size_t count) {
+        positionX.resize(count);
+        positionY.resize(count);
+        scale.resize(count);
+        rotation.resize(count);
+        materialId.resize(count);
+    }
+
+    void clear() {
+        resize(0);
+    }
+};
+
+// a draw range inside a vertex/index buffer pair
+struct MeshRange {
+    VkBuffer vertexBuffer;
+    VkBuffer indexBuffer;
+    VkIndexType indexType;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    // around the mesh origin, before the instance scale
+    float boundingRadius;
+};
+
+// Groups instances by pipeline and mesh. Each (pipeline, mesh) pair becomes one indirect draw command,
+// and the commands for one pipeline and buffer pair go out in a single vkCmdDrawIndexedIndirectCount, so
+// recording costs the same for ten objects as for a million.
+class DrawBatcher {
+public:
+    struct Batch {
+        PipelineHandle pipeline;
+        uint32_t mesh;
+        InstanceData instances;
+    };
+
+    uint32_t addMesh(const MeshRange& range) {
+        meshes.push_back(range);
+        return static_cast<uint32_t>(meshes.size() - 1);
+    }
+
+    const MeshRange& mesh(uint32_t index) const {
+        return meshes[index];
+    }
+
+    uint32_t meshCount() const {
+        return static_cast<uint32_t>(meshes.size());
+    }
+
+    // bumped by every change to the instances, so per-frame copies know when they are stale
+    uint64_t version() const {
+        return currentVersion;
+    }
+
+    // the instances drawn with this pipeline and mesh, for the caller to fill in; the reference is good until
+    // the next call
+    InstanceData& instances(PipelineHandle pipeline, uint32_t mesh) {
+        currentVersion++;
+
+        auto existing = std::find_if(sortedBatches.begin(), sortedBatches.end(), [&](const Batch& batch) {
+            return batch.pipeline == pipeline && batch.mesh == mesh;
+        });
+        if (existing != sortedBatches.end()) {
+            return existing->instances;
+        }
+
+        // kept sorted by pipeline and then by buffers, which is the order recordDrawGroups() binds them in
+        Batch batch{pipeline, mesh, {}};
+        auto position = std::upper_bound(sortedBatches.begin(), sortedBatches.end(), batch, [this](const Batch& a, const Batch& b) {
+            return std::make_tuple(a.pipeline, meshes[a.mesh].vertexBuffer, meshes[a.mesh].indexBuffer, a.mesh) <
+                std::make_tuple(b.pipeline, meshes[b.mesh].vertexBuffer, meshes[b.mesh].indexBuffer, b.mesh);
+        });
+        return sortedBatches.insert(position, std::move(batch))->instances;
+    }
+
+    const std::vector<Batch>& batches() const {
+        return sortedBatches;
+    }
+
+    // replaces every batch at once, as a frame log replay does; the batches must already be in batches() order
+    void assign(std::vector<Batch> batches) {
+        currentVersion++;
+        sortedBatches = std::move(batches);
+    }
+
+    uint32_t instanceCount() const {
+        size_t count = 0;
+        for (const auto& batch : sortedBatches) {
+            count += batch.instances.size();
+        }
+        return static_cast<uint32_t>(count);
+    }
+
+private:
+    std::vector<MeshRange> meshes;
+    std::vector<Batch> sortedBatches;
+    uint64_t currentVersion = 0;
+};
+
+// writes a frame log as the frames are drawn
+class FrameLogWriter {
+public:
+    void open(const std::string& path, VkExtent2D extent, bool drewMesh) {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("failed to open frame log for writing!");
+        }
+
+        memcpy(fileHeader.magic, FRAME_LOG_MAGIC, sizeof(FRAME_LOG_MAGIC));
+        fileHeader.version = FRAME_LOG_VERSION;
+        fileHeader.width = extent.width;
+        fileHeader.height = extent.height;
+        fileHeader.frameCount = 0;
+        fileHeader.drewMesh = drewMesh ? 1 : 0;
+        writeValue(fileHeader);
+
+        loggedVersion.reset();
+    }
+
+    bool isOpen() const {
+        return file.is_open();
+    }
+
+    uint32_t frameCount() const {
+        return fileHeader.frameCount;
+    }
+
+    void write(const DrawBatcher& batcher, bool directDraws) {
+        bool sceneChanged = loggedVersion != batcher.version();
+
+        FrameLogRecord record{};
+        record.flags = (sceneChanged ? uint32_t(FRAME_LOG_SCENE) : 0u) | (directDraws ? uint32_t(FRAME_LOG_DIRECT_DRAWS) : 0u);
+        record.batchCount = sceneChanged ? static_cast<uint32_t>(batcher.batches().size()) : 0;
+        writeValue(record);
+
+        if (sceneChanged) {
+            for (const auto& batch : batcher.batches()) {
+                const InstanceData& instances = batch.instances;
+                writeValue(FrameLogBatch{batch.pipeline, batch.mesh, static_cast<uint32_t>(instances.size())});
+                writeColumn(instances.positionX);
+                writeColumn(instances.positionY);
+                writeColumn(instances.scale);
+                writeColumn(instances.rotation);
+                writeColumn(instances.materialId);
+            }
+            loggedVersion = batcher.version();
+        }
+
+        fileHeader.frameCount++;
+    }
+
+    // fills in the frame count; false if anything failed to write
+    bool close() {
+        file.seekp(0);
+        writeValue(fileHeader);
+        file.close();
+        return !file.fail();
+    }
+
+private:
+    std::ofstream file;
+    FrameLogHeader fileHeader{};
+    std::optional<uint64_t> loggedVersion;
+
+    template <typename T>
+    void writeValue(const T& value) {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void writeColumn(const std::vector<T>& column) {
+        file.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+    }
+};
+
+// reads a frame log back one frame at a time, straight from the mapping
+class FrameLogReader {
+public:
+    struct Frame {
+        bool directDraws = false;
+        // unset on the frames that kept the previous scene
+        std::optional<std::vector<DrawBatcher::Batch>> batches;
+    };
+
+    // validates the header only; every frame is checked as next() reaches it
+    void open(MappedFile mappedFile) {
+        file = std::move(mappedFile);
+
+        if (file.size() < sizeof(FrameLogHeader)) {
+            throw std::runtime_error("failed to load frame log: file is too small!");
+        }
+        memcpy(&fileHeader, file.data(), sizeof(FrameLogHeader));
+
+        if (memcmp(fileHeader.magic, FRAME_LOG_MAGIC, sizeof(FRAME_LOG_MAGIC)) != 0 || fileHeader.version != FRAME_LOG_VERSION) {
+            throw std::runtime_error("failed to load frame log: not a version 1 frame log!");
+        }
+        if (fileHeader.width == 0 || fileHeader.height == 0) {
+            throw std::runtime_error("failed to load frame log: invalid header!");
+        }
+
+        offset = sizeof(FrameLogHeader);
+        framesRead = 0;
+    }
+
+    const FrameLogHeader& header() const {
+        return fileHeader;
+    }
+
+    // false once every frame has been read
+    bool next(Frame& frame) {
+        if (framesRead == fileHeader.frameCount) {
+            return false;
+        }
+
+        FrameLogRecord record;
+        readValue(record);
+        frame.directDraws = (record.flags & FRAME_LOG_DIRECT_DRAWS) != 0;
+        frame.batches.reset();
+
+        if (record.flags & FRAME_LOG_SCENE) {
+            // every batch takes at least its FrameLogBatch, so a damaged count fails here rather than in reserve()
+            if (uint64_t(record.batchCount) * sizeof(FrameLogBatch) > file.size() - offset) {
+                throw std::runtime_error("failed to load frame log: file is truncated!");
+            }
+
+            frame.batches.emplace();
+            frame.batches->reserve(record.batchCount);
+            for (uint32_t i = 0; i < record.batchCount; i++) {
+                FrameLogBatch logged;
+                readValue(logged);
+                // checked before the columns are sized, so a damaged count cannot ask for gigabytes
+                if (uint64_t(logged.instanceCount) * INSTANCE_BYTES > file.size() - offset) {
+                    throw std::runtime_error("failed to load frame log: file is truncated!");
+                }
+
+                DrawBatcher::Batch batch{logged.pipeline, logged.mesh, {}};
+                batch.instances.resize(logged.instanceCount);
+                readColumn(batch.instances.positionX);
+                readColumn(batch.instances.positionY);
+                readColumn(batch.instances.scale);
+                readColumn(batch.instances.rotation);
+                readColumn(batch.instances.materialId);
+                frame.batches->push_back(std::move(batch));
+            }
+        }
+
+        framesRead++;
+        return true;
+    }
+
+private:
+    MappedFile file;
+    FrameLogHeader fileHeader{};
+    size_t offset = 0;
+    uint32_t framesRead = 0;
+
+    static const uint64_t INSTANCE_BYTES = 4 * sizeof(float) + sizeof(uint32_t);
+
+    void read(void* destination, size_t size) {
+        if (size == 0) {
+            return;
+        }
+        if (size > file.size() - offset) {
+            throw std::runtime_error("failed to load frame log: file is truncated!");
+        }
+        memcpy(destination, file.data() + offset, size);
+        offset += size;
+    }
+
+    template <typename T>
+    void readValue(T& value) {
+        read(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void readColumn(std::vector<T>& column) {
+        read(column.data(), column.size() * sizeof(T));
+    }
+};
+
+class HelloTriangleApplication {
+public:
+    explicit HelloTriangleApplication(const AppConfig& config) : config(config) {
+        // a replay renders headless at the recorded extent, which decides the device extensions below
+        if (!config.replayPath.empty()) {
+            frameLogReader.open(MappedFile(config.replayPath));
+            if (frameLogReader.header().drewMesh != 0 && config.meshPath.empty()) {
+                throw std::runtime_error("failed to load frame log: it was recorded with --mesh, replay it with the same file!");
+            }
+            this->config.headless = true;
+            this->config.headlessExtent = {frameLogReader.header().width, frameLogReader.header().height};
+        }
+
+        if (!this->config.headless) {
+            deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        }
+
+        Tracer::nameCurrentThread("main");
+        Tracer::instance().setEnabled(!config.tracePath.empty());
+        overlayVisible = config.overlay;
+    }
+
+    void run() {
+        initVulkan();
+        if (!config.recordPath.empty()) {
+            frameLogWriter.open(config.recordPath, swapChainExtent, !config.meshPath.empty());
+        }
+
+        if (!config.benchmarkPath.empty()) {
+            runBenchmark();
+        } else if (!config.replayPath.empty()) {
+            replayLoop();
+        } else if (config.headless) {
+            headlessLoop();
+        } else {
+            mainLoop();
+        }
+        cleanup();
+    }
+
+private:
+    AppConfig config;
+
+    GLFWwindow* window = nullptr;
+
+    VkInstance instance;
+    VkDebugUtilsMessengerEXT debugMessenger;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    std::map<VkPhysicalDevice, DeviceCapabilities> deviceCapabilities;
+    VkDevice device;
+    std::vector<const char*> deviceExtensions;
+
+    VkQueue graphicsQueue;
+    VkQueue presentQueue;
+    VkQueue transferQueue;
+    VkQueue computeQueue = VK_NULL_HANDLE;
+
+    // Vulkan leaves keeping submissions to one VkQueue apart to the caller, and without dedicated families
+    // the queues above are one and the same; every submit and present holds the mutex of its queue
+    std::map<VkQueue, std::mutex> queueMutexes;
+
+    // families that touch buffers shared between rendering and uploads
+    std::vector<uint32_t> bufferQueueFamilies;
+
+    // Culling and the depth pyramid go to the compute queue when asyncComputeEnabled. What they share with
+    // rendering (depth, pyramid, instance and indirect buffers) is CONCURRENT across cullingQueueFamilies
+    // then, which saves ownership transfers; the compute timeline carries each frame's serial too.
+    bool asyncComputeEnabled = false;
+    std::vector<uint32_t> cullingQueueFamilies;
+    QueueTimeline computeTimeline;
+
+    // in headless mode the "swapchain" images are offscreenTargets, one per frame in flight
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+    std::vector<OffscreenTarget> offscreenTargets;
+    std::vector<VkImage> swapChainImages;
+    VkFormat swapChainImageFormat;
+    VkExtent2D swapChainExtent;
+    std::vector<VkImageView> swapChainImageViews;
+    std::vector<VkFramebuffer> swapChainFramebuffers;
+
+    // With dynamic rendering there is no renderPass and no swapChainFramebuffers: rendering begins on the
+    // image views themselves, and pipelines are built against the attachment formats.
+    bool dynamicRenderingEnabled = false;
+    PFN_vkCmdBeginRenderingKHR pfnCmdBeginRendering = nullptr;
+    PFN_vkCmdEndRenderingKHR pfnCmdEndRendering = nullptr;
+
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout;
+    PipelineHandle graphicsPipeline;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+    // ahead of jobs, so a startup task that fails leaves its error somewhere that outlives the workers
+    StartupTimer startup;
+    bool startupReported = false;
+    BackgroundTask instanceCreation;
+    BackgroundTask filePreload;
+    BackgroundTask computePipelineCreation;
+    MappedFile preloadedPipelineCache;
+
+    JobSystem jobs;
+    std::unique_ptr<ShaderModuleCache> shaderModules;
+    std::unique_ptr<PipelineLibrary> pipelineLibrary;
+    ShaderWatcher shaderWatcher;
+    std::unique_ptr<GpuProfiler> gpuProfiler;
+    std::unique_ptr<DeviceAllocator> allocator;
+    UploadQueue uploads;
+
+    VkBuffer vertexBuffer;
+    MemoryAllocation vertexBufferMemory;
+    VkBuffer indexBuffer;
+    MemoryAllocation indexBufferMemory;
+
+    PipelineHandle meshPipeline = INVALID_PIPELINE_HANDLE;
+    MeshStreamer meshStreamer;
+    VkBuffer meshVertexBuffer = VK_NULL_HANDLE;
+    MemoryAllocation meshVertexBufferMemory;
+    VkBuffer meshIndexBuffer = VK_NULL_HANDLE;
+    MemoryAllocation meshIndexBufferMemory;
+    PushConstants meshPushConstants{};
+
+    // every object that frames in flight may still be using when it is replaced goes through here instead
+    // of being destroyed on the spot, e.g. hot-reloaded pipelines and old swapchains; a frame's own buffers
+    // are only ever replaced after it has retired, so they need not
+    DeletionQueue deletionQueue;
+
+    // everything sized with the swapchain, retired together
+    struct RetiredSwapChain {
+        VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+        std::vector<VkImageView> imageViews;
+        std::vector<VkFramebuffer> framebuffers;
+        VkImage depthImage = VK_NULL_HANDLE;
+        MemoryAllocation depthImageMemory;
+        VkImageView depthImageView = VK_NULL_HANDLE;
+        VkImage msaaColorImage = VK_NULL_HANDLE;
+        MemoryAllocation msaaColorMemory;
+        VkImageView msaaColorView = VK_NULL_HANDLE;
+        VkImage msaaDepthImage = VK_NULL_HANDLE;
+        MemoryAllocation msaaDepthMemory;
+        VkImageView msaaDepthView = VK_NULL_HANDLE;
+        VkImage sceneColorImage = VK_NULL_HANDLE;
+        MemoryAllocation sceneColorMemory;
+        VkImageView sceneColorView = VK_NULL_HANDLE;
+        VkImage depthPyramid = VK_NULL_HANDLE;
+        MemoryAllocation depthPyramidMemory;
+        VkImageView depthPyramidView = VK_NULL_HANDLE;
+        std::vector<VkImageView> depthPyramidLevelViews;
+        VkDescriptorPool depthPyramidDescriptorPool = VK_NULL_HANDLE;
+    };
+
+    std::vector<FrameContext> frames;
+    uint32_t currentFrame = 0;
+
+    // every submitted frame signals the next serial on the graphics timeline
+    QueueTimeline graphicsTimeline;
+    uint64_t submittedSerial = 0;
+    uint64_t completedSerial = 0;
+
+    // GLFW events are handled on the main thread and reach the render thread through windowEvents; a full
+    // queue drops events, which the render thread treats as a possible resize
+    static const size_t WINDOW_EVENT_CAPACITY = 1024;
+    SpscQueue<WindowEvent, WINDOW_EVENT_CAPACITY> windowEvents;
+    std::atomic<uint32_t> droppedWindowEvents{0};
+    std::atomic<uint64_t> windowFramebufferSize{0};
+    std::atomic<bool> renderThreadRunning{false};
+    std::atomic<bool> closeRequested{false};
+
+    // only touched by whichever thread renders
+    bool resizePending = false;
+    double displayRefreshRate = 60.0;
+
+    bool presentWaitEnabled = false;
+    PFN_vkWaitForPresentKHR pfnWaitForPresent = nullptr;
+    uint64_t lastPresentId = 0;
+    std::chrono::steady_clock::time_point inputSampleTime;
+    std::deque<std::pair<uint64_t, std::chrono::steady_clock::time_point>> presentInputTimes;
+    LatencyStats presentLatency;
+
+    // what recordRenderPass() draws: objectCount triangles laid out on a grid, batched into indirect draws,
+    // or with one vkCmdDrawIndexed per object when directDraws is set (the baseline the benchmark compares against)
+    uint32_t objectCount = 1;
+    bool directDraws = false;
+
+    // --record writes each drawn frame to frameLogWriter; --replay takes every frame's scene from frameLogReader
+    FrameLogWriter frameLogWriter;
+    FrameLogReader frameLogReader;
+
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorPool descriptorPool;
+
+    // set 1 of the scene; the material table is the first buffer in it
+    BindlessDescriptors bindless;
+    VkBuffer materialBuffer;
+    MemoryAllocation materialBufferMemory;
+    uint32_t materialTable = 0;
+
+    DrawBatcher batcher;
+    uint32_t triangleMesh = 0;
+    uint32_t sceneObjectCount = 0;
+
+    // consecutive batches sharing a pipeline and buffers, drawn with one indirect call
+    struct DrawGroup {
+        PipelineHandle pipeline;
+        uint32_t mesh;
+        uint32_t firstCommand;
+        uint32_t commandCount;
+    };
+    std::vector<DrawGroup> drawGroups;
+    uint64_t drawGroupsVersion = 0;
+
+    bool drawIndirectCountEnabled = false;
+
+    // depth for the render pass, and the max-depth pyramid the next frame's culling pass tests against
+    static const uint32_t MAX_PYRAMID_LEVELS = 16;
+    VkFormat depthFormat;
+    VkImage depthImage;
+    MemoryAllocation depthImageMemory;
+    VkImageView depthImageView;
+
+    // With MSAA the scene renders into these and resolves into the swapchain image and depthImage. They
+    // are transient: nothing reads them after the pass, so on a tiled GPU they never leave tile memory.
+    VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+    VkImage msaaColorImage = VK_NULL_HANDLE;
+    MemoryAllocation msaaColorMemory;
+    VkImageView msaaColorView = VK_NULL_HANDLE;
+    VkImage msaaDepthImage = VK_NULL_HANDLE;
+    MemoryAllocation msaaDepthMemory;
+    VkImageView msaaDepthView = VK_NULL_HANDLE;
+
+    // With dynamic resolution the scene renders into the top-left renderExtent of sceneColorImage and
+    // depthImage, which stay at the swapchain size so the scale can change every frame without
+    // reallocating anything; recordUpscale() blits that corner up into the swapchain image.
+    bool dynamicResolutionEnabled = false;
+    double resolutionScale = 1.0;
+    VkExtent2D renderExtent = {0, 0};
+    VkImage sceneColorImage = VK_NULL_HANDLE;
+    MemoryAllocation sceneColorMemory;
+    VkImageView sceneColorView = VK_NULL_HANDLE;
+
+    // the part of depthImage the last recorded scene pass wrote, which the next pyramid build reduces
+    VkExtent2D renderedDepthExtent = {0, 0};
+
+    VkImage depthPyramid;
+    MemoryAllocation depthPyramidMemory;
+    VkImageView depthPyramidView;
+    std::vector<VkImageView> depthPyramidLevelViews;
+    VkExtent2D depthPyramidExtent;
+    uint32_t depthPyramidLevels = 0;
+    // a new pyramid is cleared to the far plane before its first use, which culls nothing
+    bool depthPyramidNeedsClear = true;
+    VkSampler depthSampler;
+
+    VkDescriptorSetLayout depthPyramidSetLayout;
+    VkDescriptorPool depthPyramidDescriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> depthPyramidSets;
+
+    VkPipelineLayout cullPipelineLayout;
+    VkPipelineLayout depthPyramidPipelineLayout;
+    VkPipeline cullInstancesPipeline;
+    VkPipeline writeCommandsPipeline;
+    VkPipeline depthPyramidPipeline;
+
+    VkPresentModeKHR swapChainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+    // CPU time spent recording and submitting the last frame
+    double lastSubmitCpuMs = 0.0;
+
+    // telemetry: the overlay text is rebuilt every TELEMETRY_INTERVAL_S whether it is shown or not, and each
+    // frame copies it into its overlay buffer when that falls behind overlayVersion
+    bool memoryBudgetEnabled = false;
+    PipelineHandle overlayPipeline = INVALID_PIPELINE_HANDLE;
+    bool overlayVisible = false;
+    std::vector<uint32_t> overlayGlyphs;
+    uint64_t overlayVersion = 0;
+    std::chrono::steady_clock::time_point telemetryStart;
+    std::optional<std::chrono::steady_clock::time_point> lastFrameStart;
+    double averageFrameMs = 0.0;
+    Telemetry::Snapshot lastTelemetry;
+    bool statsWriteFailed = false;
+
+    void initWindow() {
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+
+        window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+        glfwSetWindowUserPointer(window, this);
+        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+        glfwSetKeyCallback(window, keyCallback);
+
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        storeFramebufferSize(width, height);
+        displayRefreshRate = queryDisplayRefreshRate();
+    }
+
+    // the callbacks run on the main thread, inside glfwWaitEvents() or glfwPollEvents()
+    static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
+        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+        app->storeFramebufferSize(width, height);
+
+        WindowEvent event;
+        event.type = WindowEvent::Type::Resize;
+        event.width = width;
+        event.height = height;
+        event.time = std::chrono::steady_clock::now();
+        app->pushWindowEvent(event);
+    }
+
+    static void keyCallback(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/) {
+        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+
+        WindowEvent event;
+        event.type = WindowEvent::Type::Key;
+        event.key = key;
+        event.action = action;
+        event.time = std::chrono::steady_clock::now();
+        app->pushWindowEvent(event);
+    }
+
+    void pushWindowEvent(const WindowEvent& event) {
+        if (!windowEvents.push(event)) {
+            droppedWindowEvents.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void storeFramebufferSize(int width, int height) {
+        windowFramebufferSize.store(uint64_t(uint32_t(width)) << 32 | uint32_t(height), std::memory_order_relaxed);
+    }
+
+    // the size the main thread last saw, so the render thread never has to ask GLFW
+    VkExtent2D framebufferExtent() const {
+        uint64_t size = windowFramebufferSize.load(std::memory_order_relaxed);
+        return {static_cast<uint32_t>(size >> 32), static_cast<uint32_t>(size)};
+    }
+
+    // Runs on the thread that renders, once per frame. Input is sampled here, so the input-to-present latency
+    // runs from the oldest key event the frame is the first to see, or from now when there is none.
+    void processWindowEvents() {
+        inputSampleTime = std::chrono::steady_clock::now();
+
+        WindowEvent event;
+        while (windowEvents.pop(event)) {
+            if (event.type == WindowEvent::Type::Resize) {
+                resizePending = true;
+            } else if (event.type == WindowEvent::Type::Key && event.action == GLFW_PRESS) {
+                inputSampleTime = std::min(inputSampleTime, event.time);
+                if (event.key == GLFW_KEY_F3) {
+                    overlayVisible = !overlayVisible;
+                }
+            }
+        }
+
+        if (droppedWindowEvents.exchange(0, std::memory_order_relaxed) > 0) {
+            resizePending = true;
+        }
+    }
+
+    // blocks until something may have changed the window; off the main thread GLFW cannot be waited on, so
+    // the render thread naps instead while the main thread keeps the window responsive
+    void waitForWindowEvents() {
+        if (renderThreadRunning) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            processWindowEvents();
+        } else {
+            glfwWaitEvents();
+        }
+    }
+
+    // Work that does not depend on each other overlaps: the instance is created and the shaders and pipeline
+    // cache are read on workers while GLFW opens the window, and everything the pipelines need is set up
+    // ahead of the swapchain, so they compile while it and the remaining resources are created.
+    void initVulkan() {
+        // glfwGetRequiredInstanceExtensions() only needs GLFW initialized, not the window
+        if (!config.headless) {
+            glfwInit();
+        }
+
+        filePreload.start(jobs, [this] { preloadStartupFiles(); });
+        instanceCreation.start(jobs, [this] {
+            createInstance();
+            setupDebugMessenger();
+        });
+        if (!config.headless) {
+            initWindow();
+        }
+        instanceCreation.wait(jobs);
+        startup.phase("instance and window");
+
+        createSurface();
+        pickPhysicalDevice();
+        startup.phase("device selection");
+
+        createLogicalDevice();
+        createAllocator();
+        createUploadQueue();
+        filePreload.wait(jobs);
+        createPipelineCache();
+        startup.phase("device");
+
+        chooseSceneFormat();
+        setupDynamicResolution();
+        createRenderPass();
+        createDescriptorSetLayout();
+        createBindlessDescriptors();
+        createPipelineLayout();
+        createPipelines();
+        computePipelineCreation.start(jobs, [this] { createComputePipelines(); });
+        startup.phase("pipeline setup");
+
+        if (config.headless) {
+            createOffscreenTargets();
+        } else {
+            createSwapChain();
+        }
+        createImageViews();
+        createVertexBuffer();
+        createIndexBuffer();
+        createMaterials();
+        createScene();
+        createMesh();
+        createMultisampleTargets();
+        createSceneColorTarget();
+        createDepthResources();
+        createFramebuffers();
+        createFrameContexts();
+        createDepthSampler();
+        createDescriptorPool();
+        createDescriptorSets();
+        createGpuProfiler();
+        createCommandPools();
+        createCommandBuffers();
+        createSyncObjects();
+        createReadbackBuffers();
+        createOverlayBuffers();
+        createShaderWatcher();
+        computePipelineCreation.wait(jobs);
+        startup.phase("resources");
+
+        telemetryStart = std::chrono::steady_clock::now();
+        lastTelemetry = Telemetry::instance().snapshot();
+    }
+
+    // GLFW wants its events handled on the main thread, so the main thread does nothing else and rendering
+    // moves to a thread of its own. A slow frame then never stalls the window, and input is queued the
+    // moment it arrives rather than when the next frame gets around to polling.
+    void mainLoop() {
+        std::exception_ptr renderError;
+        renderThreadRunning = true;
+        std::thread renderThread([this, &renderError] {
+            Tracer::nameCurrentThread("render");
+            try {
+                renderLoop();
+            } catch (...) {
+                renderError = std::current_exception();
+            }
+
+            renderThreadRunning = false;
+            glfwPostEmptyEvent();
+        });
+
+        while (!glfwWindowShouldClose(window) && renderThreadRunning) {
+            TRACE_SCOPE("wait for events");
+            glfwWaitEvents();
+        }
+
+        closeRequested = true;
+        renderThread.join();
+
+        if (renderError) {
+            std::rethrow_exception(renderError);
+        }
+    }
+
+    void renderLoop() {
+        while (!closeRequested) {
+            waitForPresent();
+            {
+                TRACE_SCOPE("process events");
+                processWindowEvents();
+            }
+            drawFrame();
+        }
+
+        waitDeviceIdle();
+    }
+
+    void headlessLoop() {
+        auto startTime = std::chrono::steady_clock::now();
+
+        for (uint32_t i = 0; i < config.frameCount; i++) {
+            drawOffscreenFrame();
+        }
+
+        waitDeviceIdle();
+        deliverPendingReadbacks();
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        std::cout << "rendered " << config.frameCount << " frames in " << seconds << " s ("
+            << config.frameCount / seconds << " frames/s)" << std::endl;
+    }
+
+    // the last frames in flight have not been read back yet
+    void deliverPendingReadbacks() {
+        for (uint32_t i = 0; i < frames.size(); i++) {
+            FrameContext& frame = frames[(currentFrame + i) % frames.size()];
+            if (frame.serial > completedSerial) {
+                deliverReadback(frame);
+            }
+        }
+    }
+
+    // draws every frame of the frame log with its recorded scene; nothing else changes the scene meanwhile,
+    // since updateScene() only rebuilds it when objectCount moves
+    void replayLoop() {
+        // a frame drawn before its pipelines compiled would draw nothing and skew the timing
+        pipelineLibrary->waitIdle();
+
+        auto startTime = std::chrono::steady_clock::now();
+
+        FrameLogReader::Frame logged;
+        uint32_t frameCount = 0;
+        while (frameLogReader.next(logged)) {
+            directDraws = logged.directDraws;
+            if (logged.batches) {
+                for (const auto& batch : *logged.batches) {
+                    if (batch.pipeline >= pipelineLibrary->size() || batch.mesh >= batcher.meshCount()) {
+                        throw std::runtime_error("failed to replay frame log: frame " + std::to_string(frameCount) + " draws a pipeline or mesh this run does not have!");
+                    }
+                }
+                batcher.assign(std::move(*logged.batches));
+            }
+
+            drawOffscreenFrame();
+            frameCount++;
+        }
+
+        waitDeviceIdle();
+        deliverPendingReadbacks();
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        std::cout << "replayed " << frameCount << " frames in " << seconds << " s ("
+            << frameCount / seconds << " frames/s)" << std::endl;
+    }
+
+    // renders config.frameCount frames of each scenario after a short warm-up and writes the frame time
+    // distribution of each to config.benchmarkPath
+    void runBenchmark() {
+        const uint32_t WARMUP_FRAMES = 30;
+
+        waitForPipeline(graphicsPipeline);
+
+        std::vector<BenchmarkScenario> scenarios = {
+            {"single triangle", 1, 1, 0, std::nullopt},
+            {"10k triangles, indirect", 1, 10000, 0, std::nullopt},
+            {"1M triangles, indirect", 1, 1000000, 0, std::nullopt},
+            {"1k direct draws", 1000, 1, 0, std::nullopt},
+            {"10k direct draws", 10000, 1, 0, std::nullopt},
+        };
+        if (!config.headless) {
+            scenarios.push_back({"resize storm", 1, 1, 10, std::nullopt});
+
+            std::vector<VkPresentModeKHR> supportedModes = querySwapChainSupport(physicalDevice).presentModes;
+            for (VkPresentModeKHR presentMode : {VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR}) {
+                if (std::find(supportedModes.begin(), supportedModes.end(), presentMode) != supportedModes.end()) {
+                    scenarios.push_back({std::string("present ") + presentModeName(presentMode), 1, 1, 0, presentMode});
+                }
+            }
+        }
+
+        std::optional<VkPresentModeKHR> defaultPresentMode = config.presentMode;
+
+        std::vector<BenchmarkResult> results;
+        for (const auto& scenario : scenarios) {
+            objectCount = scenario.draws * scenario.instancesPerDraw;
+            directDraws = scenario.draws > 1;
+            // no frame is in flight on the CPU here, so the scene can switch before the first frame records
+            updateScene();
+            if (!config.headless) {
+                // vsync off unless the scenario is about present modes
+                config.presentMode = scenario.presentMode ? scenario.presentMode : VK_PRESENT_MODE_IMMEDIATE_KHR;
+                recreateSwapChain();
+            }
+
+            BenchmarkResult result;
+            result.scenario = scenario.name;
+            result.triangles = scenario.draws * scenario.instancesPerDraw;
+            result.draws = scenario.draws;
+            result.presentMode = config.headless ? "none" : presentModeName(swapChainPresentMode);
+
+            auto previousFrameStart = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < WARMUP_FRAMES + config.frameCount; i++) {
+                if (!config.headless && glfwWindowShouldClose(window)) {
+                    break;
+                }
+
+                if (scenario.resizeInterval != 0 && i % scenario.resizeInterval == 0) {
+                    bool shrink = (i / scenario.resizeInterval) % 2 == 0;
+                    glfwSetWindowSize(window, shrink ? WIDTH / 2 : WIDTH, shrink ? HEIGHT / 2 : HEIGHT);
+                }
+
+                benchmarkFrame();
+
+                auto frameStart = std::chrono::steady_clock::now();
+                if (i >= WARMUP_FRAMES) {
+                    result.frameTimesMs.push_back(std::chrono::duration<double, std::milli>(frameStart - previousFrameStart).count());
+                    result.submitCpuMs.push_back(lastSubmitCpuMs);
+                }
+                previousFrameStart = frameStart;
+            }
+
+            waitDeviceIdle();
+            std::cout << "benchmark " << result.scenario << ": " << result.frameTimesMs.size() << " frames" << std::endl;
+            results.push_back(std::move(result));
+        }
+
+        if (!config.headless) {
+            glfwSetWindowSize(window, WIDTH, HEIGHT);
+            config.presentMode = defaultPresentMode;
+        }
+        objectCount = 1;
+        directDraws = false;
+
+        writeBenchmarkResults(results);
+    }
+
+    void benchmarkFrame() {
+        if (config.headless) {
+            drawOffscreenFrame();
+        } else {
+            glfwPollEvents();
+            processWindowEvents();
+            drawFrame();
+        }
+    }
+
+    // keeps clearing frames until the pipeline is built, since until then nothing but the clear gets measured
+    void waitForPipeline(PipelineHandle handle) {
+        const auto timeout = std::chrono::seconds(30);
+
+        auto startTime = std::chrono::steady_clock::now();
+        while (!pipelineLibrary->isReady(handle)) {
+            if (std::chrono::steady_clock::now() - startTime > timeout) {
+                throw std::runtime_error("failed to build pipeline for benchmark!");
+            }
+            benchmarkFrame();
+        }
+    }
+
+    void writeBenchmarkResults(const std::vector<BenchmarkResult>& results) {
+        const double HISTOGRAM_BUCKET_MS = 0.25;
+        const size_t HISTOGRAM_BUCKETS = 200;
+
+        const VkPhysicalDeviceProperties& properties = capabilities(physicalDevice).properties;
+
+        std::ofstream file(config.benchmarkPath);
+        if (!file) {
+            throw std::runtime_error("failed to open benchmark results file!");
+        }
+
+        auto writeDistribution = [&](std::vector<double> samples) {
+            std::sort(samples.begin(), samples.end());
+            auto percentile = [&](double p) {
+                return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))];
+            };
+
+            double total = 0.0;
+            for (double sample : samples) {
+                total += sample;
+            }
+
+            file << "{\"min\": " << samples.front() << ", \"avg\": " << total / samples.size() << ", \"p50\": " << percentile(0.50)
+                << ", \"p95\": " << percentile(0.95) << ", \"p99\": " << percentile(0.99) << ", \"max\": " << samples.back() << "}";
+        };
+
+        file << "{\n  \"device\": \"" << properties.deviceName << "\",\n  \"build\": \"" << (enableValidationLayers ? "debug" : "release")
+            << "\",\n  \"framesInFlight\": " << config.framesInFlight << ",\n  \"extent\": [" << swapChainExtent.width << ", "
+            << swapChainExtent.height << "],\n  \"histogramBucketMs\": " << HISTOGRAM_BUCKET_MS << ",\n  \"scenarios\": [";
+
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchmarkResult& result = results[i];
+            file << (i == 0 ? "" : ",") << "\n    {\"name\": \"" << result.scenario << "\", \"triangles\": " << result.triangles
+                << ", \"draws\": " << result.draws << ", \"presentMode\": \"" << result.presentMode << "\", \"frames\": "
+                << result.frameTimesMs.size();
+
+            if (!result.frameTimesMs.empty()) {
+                // the last bucket collects everything slower
+                std::vector<uint32_t> histogram(HISTOGRAM_BUCKETS);
+                for (double frameTime : result.frameTimesMs) {
+                    histogram[std::min(HISTOGRAM_BUCKETS - 1, static_cast<size_t>(frameTime / HISTOGRAM_BUCKET_MS))]++;
+                }
+
+                file << ",\n     \"frameTimeMs\": ";
+                writeDistribution(result.frameTimesMs);
+                file << ",\n     \"submitCpuMs\": ";
+                writeDistribution(result.submitCpuMs);
+                file << ",\n     \"frameTimeHistogram\": [";
+                for (size_t bucket = 0; bucket < histogram.size(); bucket++) {
+                    file << (bucket == 0 ? "" : ", ") << histogram[bucket];
+                }
+                file << "]";
+            }
+            file << "}";
+        }
+        file << "\n  ]\n}\n";
+
+        std::cout << "wrote benchmark results to " << config.benchmarkPath << std::endl;
+    }
+
+    // sleeps until the previous frame is on screen so input is sampled as late as possible, and records how
+    // long each frame took from input sampling to being displayed
+    void waitForPresent() {
+        if (!presentWaitEnabled || lastPresentId == 0) {
+            return;
+        }
+
+        TRACE_SCOPE("wait for present");
+        if (pfnWaitForPresent(device, swapChain, lastPresentId, PRESENT_WAIT_TIMEOUT_NS) != VK_SUCCESS) {
+            return;
+        }
+
+        auto presentedTime = std::chrono::steady_clock::now();
+        while (!presentInputTimes.empty() && presentInputTimes.front().first <= lastPresentId) {
+            if (presentInputTimes.front().first == lastPresentId) {
+                presentLatency.add(std::chrono::duration<double, std::milli>(presentedTime - presentInputTimes.front().second).count());
+            }
+            presentInputTimes.pop_front();
+        }
+    }
+
+    void cleanupSwapChain() {
+        RetiredSwapChain current = takeSwapChain();
+        destroySwapChain(current);
+    }
+
+    // hands the current swapchain and everything sized with it to the caller; the swapChain handle itself
+    // stays set, so createSwapChain() can still pass it on as oldSwapchain
+    RetiredSwapChain takeSwapChain() {
+        RetiredSwapChain retired;
+        retired.swapChain = swapChain;
+        retired.imageViews = std::move(swapChainImageViews);
+        retired.framebuffers = std::move(swapChainFramebuffers);
+        retired.depthImage = depthImage;
+        retired.depthImageMemory = depthImageMemory;
+        retired.depthImageView = depthImageView;
+        retired.msaaColorImage = msaaColorImage;
+        retired.msaaColorMemory = msaaColorMemory;
+        retired.msaaColorView = msaaColorView;
+        retired.msaaDepthImage = msaaDepthImage;
+        retired.msaaDepthMemory = msaaDepthMemory;
+        retired.msaaDepthView = msaaDepthView;
+        retired.sceneColorImage = sceneColorImage;
+        retired.sceneColorMemory = sceneColorMemory;
+        retired.sceneColorView = sceneColorView;
+        retired.depthPyramid = depthPyramid;
+        retired.depthPyramidMemory = depthPyramidMemory;
+        retired.depthPyramidView = depthPyramidView;
+        retired.depthPyramidLevelViews = std::move(depthPyramidLevelViews);
+        retired.depthPyramidDescriptorPool = depthPyramidDescriptorPool;
+
+        swapChainImageViews.clear();
+        swapChainFramebuffers.clear();
+        depthPyramidLevelViews.clear();
+        depthPyramidDescriptorPool = VK_NULL_HANDLE;
+        return retired;
+    }
+
+    void destroySwapChain(RetiredSwapChain& retired) {
+        for (auto framebuffer : retired.framebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+
+        for (auto imageView : retired.imageViews) {
+            vkDestroyImageView(device, imageView, nullptr);
+        }
+
+        for (auto levelView : retired.depthPyramidLevelViews) {
+            vkDestroyImageView(device, levelView, nullptr);
+        }
+        vkDestroyImageView(device, retired.depthPyramidView, nullptr);
+        vkDestroyImage(device, retired.depthPyramid, nullptr);
+        allocator->free(retired.depthPyramidMemory);
+        vkDestroyImageView(device, retired.depthImageView, nullptr);
+        vkDestroyImage(device, retired.depthImage, nullptr);
+        allocator->free(retired.depthImageMemory);
+        vkDestroyImageView(device, retired.msaaColorView, nullptr);
+        vkDestroyImage(device, retired.msaaColorImage, nullptr);
+        allocator->free(retired.msaaColorMemory);
+        vkDestroyImageView(device, retired.msaaDepthView, nullptr);
+        vkDestroyImage(device, retired.msaaDepthImage, nullptr);
+        allocator->free(retired.msaaDepthMemory);
+        vkDestroyImageView(device, retired.sceneColorView, nullptr);
+        vkDestroyImage(device, retired.sceneColorImage, nullptr);
+        allocator->free(retired.sceneColorMemory);
+        vkDestroyDescriptorPool(device, retired.depthPyramidDescriptorPool, nullptr);
+
+        if (retired.swapChain != VK_NULL_HANDLE) {
+            vkDestroySwapchainKHR(device, retired.swapChain, nullptr);
+        }
+    }
+
+    void cleanup() {
+        shaderWatcher.stop();
+        meshStreamer.stop();
+
+        if (frameLogWriter.isOpen()) {
+            uint32_t loggedFrames = frameLogWriter.frameCount();
+            if (frameLogWriter.close()) {
+                std::cout << "wrote " << loggedFrames << " frames to " << config.recordPath << std::endl;
+            } else {
+                std::cerr << "failed to write frame log to " << config.recordPath << "!" << std::endl;
+            }
+        }
+
+        if (presentLatency.samples > 0) {
+            std::cout << "input-to-present latency: avg " << presentLatency.averageMs() << " ms, max " << presentLatency.maxMs
+                << " ms over " << presentLatency.samples << " frames" << std::endl;
+        }
+
+        if (gpuProfiler) {
+            for (const auto& [name, stats] : gpuProfiler->stats()) {
+                std::cout << "gpu " << name << ": min " << stats.minMs << " ms, avg " << stats.averageMs << " ms, p99 "
+                    << stats.p99Ms << " ms over " << stats.samples << " frames" << std::endl;
+            }
+            gpuProfiler->destroy();
+        }
+
+        if (!config.tracePath.empty()) {
+            pipelineLibrary->waitIdle();
+            if (Tracer::instance().writeChromeTrace(config.tracePath)) {
+                std::cout << "wrote trace to " << config.tracePath << std::endl;
+            } else {
+                std::cerr << "failed to write trace to " << config.tracePath << "!" << std::endl;
+            }
+        }
+
+        // the loops idle the device before returning, so everything retired can go now
+        deletionQueue.flushAll();
+        cleanupSwapChain();
+
+        pipelineLibrary->destroy();
+        vkDestroyPipeline(device, cullInstancesPipeline, nullptr);
+        vkDestroyPipeline(device, writeCommandsPipeline, nullptr);
+        vkDestroyPipeline(device, depthPyramidPipeline, nullptr);
+        shaderModules->destroy();
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+        vkDestroyPipelineLayout(device, depthPyramidPipelineLayout, nullptr);
+
+        savePipelineCache();
+        vkDestroyPipelineCache(device, pipelineCache, nullptr);
+
+        vkDestroyRenderPass(device, renderPass, nullptr);
+
+        for (auto& frame : frames) {
+            vkDestroySemaphore(device, frame.renderFinishedSemaphore, nullptr);
+            vkDestroySemaphore(device, frame.imageAvailableSemaphore, nullptr);
+
+            vkDestroyCommandPool(device, frame.commandPool, nullptr);
+            for (auto& workerPool : frame.workerPools) {
+                vkDestroyCommandPool(device, workerPool.commandPool, nullptr);
+            }
+            if (frame.computeCommandPool != VK_NULL_HANDLE) {
+                vkDestroyCommandPool(device, frame.computeCommandPool, nullptr);
+            }
+
+            if (frame.readbackBuffer != VK_NULL_HANDLE) {
+                vkDestroyBuffer(device, frame.readbackBuffer, nullptr);
+                allocator->free(frame.readbackMemory);
+            }
+            vkDestroyBuffer(device, frame.overlayBuffer, nullptr);
+            allocator->free(frame.overlayMemory);
+            destroyInstanceBuffers(frame);
+            destroyBatchBuffers(frame);
+        }
+        graphicsTimeline.destroy();
+        if (asyncComputeEnabled) {
+            computeTimeline.destroy();
+        }
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, depthPyramidSetLayout, nullptr);
+        bindless.destroy();
+        vkDestroySampler(device, depthSampler, nullptr);
+
+        for (auto& target : offscreenTargets) {
+            vkDestroyImage(device, target.image, nullptr);
+            allocator->free(target.memory);
+        }
+
+        uploads.destroy();
+        if (meshVertexBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, meshIndexBuffer, nullptr);
+            allocator->free(meshIndexBufferMemory);
+            vkDestroyBuffer(device, meshVertexBuffer, nullptr);
+            allocator->free(meshVertexBufferMemory);
+        }
+        vkDestroyBuffer(device, indexBuffer, nullptr);
+        allocator->free(indexBufferMemory);
+        vkDestroyBuffer(device, vertexBuffer, nullptr);
+        allocator->free(vertexBufferMemory);
+        vkDestroyBuffer(device, materialBuffer, nullptr);
+        allocator->free(materialBufferMemory);
+
+        if (enableValidationLayers) {
+            allocator->printStats();
+        }
+        allocator->destroy();
+
+        vkDestroyDevice(device, nullptr);
+
+        if (enableValidationLayers) {
+            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+        }
+
+        if (surface != VK_NULL_HANDLE) {
+            vkDestroySurfaceKHR(instance, surface, nullptr);
+        }
+        vkDestroyInstance(instance, nullptr);
+
+        if (window != nullptr) {
+            glfwDestroyWindow(window);
+
+            glfwTerminate();
+        }
+    }
+
+    void recreateSwapChain() {
+        TRACE_SCOPE("recreate swapchain");
+
+        // minimized; during shutdown the old swapchain is good enough to tear down
+        while (framebufferExtent().width == 0 || framebufferExtent().height == 0) {
+            if (closeRequested) {
+                return;
+            }
+            waitForWindowEvents();
+        }
+
+        // Frames still in flight keep using the old chain's images, views and framebuffers, so instead of
+        // idling the device they go to the deletion queue, tagged with the last frame submitted. The old
+        // swapchain goes to createSwapChain() so the driver can hand its resources over to the new one.
+        RetiredSwapChain retired = takeSwapChain();
+        Telemetry::instance().add(Telemetry::SwapchainRecreations);
+
+        // present ids belong to the old swapchain
+        lastPresentId = 0;
+        presentInputTimes.clear();
+
+        createSwapChain(retired.swapChain);
+        createImageViews();
+        createMultisampleTargets();
+        createSceneColorTarget();
+        createDepthResources();
+        updateDepthPyramidDescriptors();
+        createFramebuffers();
+
+        deletionQueue.push(submittedSerial, [this, retired]() mutable { destroySwapChain(retired); });
+    }
+
+    void createInstance() {
+        if (enableValidationLayers && !checkValidationLayerSupport()) {
+            throw std::runtime_error("validation layers requested, but not available!");
+        }
+
+        VkApplicationInfo appInfo{};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "Hello Triangle";
+        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.pEngineName = "No Engine";
+        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.apiVersion = VK_API_VERSION_1_2;
+
+        VkInstanceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        createInfo.pApplicationInfo = &appInfo;
+
+        auto extensions = getRequiredExtensions();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
+        createInfo.flags = VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;  // macOS specific fix
+
+        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+        if (enableValidationLayers) {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+
+            populateDebugMessengerCreateInfo(debugCreateInfo);
+            createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*) &debugCreateInfo;
+        } else {
+            createInfo.enabledLayerCount = 0;
+
+            createInfo.pNext = nullptr;
+        }
+
+        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create instance!");
+        }
+    }
+
+    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
+        createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+        createInfo.pfnUserCallback = debugCallback;
+    }
+
+    void setupDebugMessenger() {
+        if (!enableValidationLayers) return;
+
+        VkDebugUtilsMessengerCreateInfoEXT createInfo;
+        populateDebugMessengerCreateInfo(createInfo);
+
+        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS) {
+            throw std::runtime_error("failed to set up debug messenger!");
+        }
+    }
+
+    void createSurface() {
+        if (config.headless) {
+            return;
+        }
+
+        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create window surface!");
+        }
+    }
+
+    void pickPhysicalDevice() {
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+
+        if (deviceCount == 0) {
+            throw std::runtime_error("failed to find GPUs with Vulkan support!");
+        }
+
+        std::vector<VkPhysicalDevice> devices(deviceCount);
+        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+        std::optional<uint32_t> chosen;
+        if (!config.gpu.empty()) {
+            chosen = findRequestedDevice(devices);
+            if (!isDeviceSuitable(devices[chosen.value()])) {
+                throw std::runtime_error("requested GPU " + config.gpu + " is not suitable!");
+            }
+        } else {
+            uint64_t bestScore = 0;
+            for (uint32_t i = 0; i < deviceCount; i++) {
+                if (!isDeviceSuitable(devices[i])) {
+                    continue;
+                }
+
+                uint64_t score = scorePhysicalDevice(devices[i]);
+                if (!chosen || score > bestScore) {
+                    chosen = i;
+                    bestScore = score;
+                }
+            }
+        }
+
+        if (!chosen) {
+            throw std::runtime_error("failed to find a suitable GPU!");
+        }
+
+        physicalDevice = devices[chosen.value()];
+
+        const DeviceCapabilities& chosenDevice = capabilities(physicalDevice);
+        std::cout << "using GPU " << chosen.value() << ": " << chosenDevice.properties.deviceName << " (" << formatUuid(chosenDevice.uuid) << ")" << std::endl;
+    }
+
+    // --gpu takes an index when it is all digits, and a deviceUUID (with or without the dashes) otherwise
+    uint32_t findRequestedDevice(const std::vector<VkPhysicalDevice>& devices) {
+        if (std::all_of(config.gpu.begin(), config.gpu.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); })) {
+            uint64_t index = parseUnsigned("--gpu", config.gpu, UINT32_MAX);
+            if (index >= devices.size()) {
+                throw std::runtime_error("GPU index " + config.gpu + " is out of range, there are " + std::to_string(devices.size()) + "!");
+            }
+            return static_cast<uint32_t>(index);
+        }
+
+        std::string requested;
+        for (char c : config.gpu) {
+            if (c != '-') {
+                requested += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+        }
+
+        for (uint32_t i = 0; i < devices.size(); i++) {
+            std::string uuid = formatUuid(capabilities(devices[i]).uuid);
+            uuid.erase(std::remove(uuid.begin(), uuid.end(), '-'), uuid.end());
+            if (uuid == requested) {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("failed to find GPU with UUID " + config.gpu + "!");
+    }
+
+    // Filled in for every device by pickPhysicalDevice(), on the main thread before anything else runs, so
+    // the lookups that come later from the render thread only ever read.
+    const DeviceCapabilities& capabilities(VkPhysicalDevice device) {
+        auto found = deviceCapabilities.find(device);
+        if (found != deviceCapabilities.end()) {
+            return found->second;
+        }
+
+        return deviceCapabilities.emplace(device, queryCapabilities(device)).first->second;
+    }
+
+    DeviceCapabilities queryCapabilities(VkPhysicalDevice device) {
+        DeviceCapabilities result;
+
+        vkGetPhysicalDeviceProperties(device, &result.properties);
+        vkGetPhysicalDeviceFeatures(device, &result.features);
+        vkGetPhysicalDeviceMemoryProperties(device, &result.memoryProperties);
+        result.vulkan12Features = queryVulkan12Features(device);
+
+        VkPhysicalDeviceIDProperties idProperties{};
+        idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &idProperties;
+        vkGetPhysicalDeviceProperties2(device, &properties);
+        std::copy(std::begin(idProperties.deviceUUID), std::end(idProperties.deviceUUID), result.uuid.begin());
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+        result.queueFamilies.resize(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, result.queueFamilies.data());
+        result.queueFamilyIndices = queryQueueFamilies(device, result.queueFamilies);
+
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+        for (const auto& extension : availableExtensions) {
+            result.extensions.emplace_back(extension.extensionName);
+        }
+        std::sort(result.extensions.begin(), result.extensions.end());
+
+        result.presentWait = queryPresentWaitSupport(device, result);
+        result.dynamicRendering = queryDynamicRenderingSupport(device, result);
+
+        if (surface != VK_NULL_HANDLE) {
+            uint32_t formatCount;
+            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+            result.surfaceFormats.resize(formatCount);
+            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, result.surfaceFormats.data());
+
+            uint32_t presentModeCount;
+            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+            result.presentModes.resize(presentModeCount);
+            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, result.presentModes.data());
+        }
+
+        return result;
+    }
+
+    // Only ranks devices that already passed isDeviceSuitable(). The device type decides first, then
+    // device-local memory, and the optional queues and features this renderer uses break the ties a
+    // little above that: each is worth about as much as a GiB of VRAM.
+    uint64_t scorePhysicalDevice(VkPhysicalDevice device) {
+        const uint64_t MIB = 1024 * 1024;
+        const uint64_t FEATURE_SCORE = 1024;
+        const uint64_t TYPE_SCORE = 1ull << 32;
+
+        const DeviceCapabilities& caps = capabilities(device);
+
+        uint64_t score = 0;
+        switch (caps.properties.deviceType) {
+            case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score += 4 * TYPE_SCORE; break;
+            case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 3 * TYPE_SCORE; break;
+            case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score += 2 * TYPE_SCORE; break;
+            case VK_PHYSICAL_DEVICE_TYPE_CPU: score += 1 * TYPE_SCORE; break;
+            default: break;
+        }
+
+        // the largest device-local heap, in MiB
+        const VkPhysicalDeviceMemoryProperties& memoryProperties = caps.memoryProperties;
+        VkDeviceSize largestHeap = 0;
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+            if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+                largestHeap = std::max(largestHeap, memoryProperties.memoryHeaps[i].size);
+            }
+        }
+        score += largestHeap / MIB;
+
+        const QueueFamilyIndices& indices = caps.queueFamilyIndices;
+        if (indices.transferFamily != indices.graphicsFamily) {
+            score += FEATURE_SCORE;
+        }
+        if (indices.computeFamily) {
+            score += FEATURE_SCORE;
+        }
+
+        if (caps.vulkan12Features.drawIndirectCount) {
+            score += FEATURE_SCORE;
+        }
+        if (caps.dynamicRendering) {
+            score += FEATURE_SCORE;
+        }
+        if (config.paceFrames && !config.headless && caps.presentWait) {
+            score += FEATURE_SCORE;
+        }
+
+        return score;
+    }
+
+    std::mutex& queueMutex(VkQueue queue) {
+        return queueMutexes.at(queue);
+    }
+
+    // vkDeviceWaitIdle() counts as a use of every queue; the mutexes are always taken in map order
+    void waitDeviceIdle() {
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (auto& entry : queueMutexes) {
+            locks.emplace_back(entry.second);
+        }
+        vkDeviceWaitIdle(device);
+    }
+
+    void createLogicalDevice() {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+        asyncComputeEnabled = config.asyncCompute && indices.computeFamily.has_value();
+
+        std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value_or(indices.graphicsFamily.value()),
+            indices.transferFamily.value()};
+        if (asyncComputeEnabled) {
+            uniqueQueueFamilies.insert(indices.computeFamily.value());
+        }
+
+        float queuePriority = 1.0f;
+        for (uint32_t queueFamily : uniqueQueueFamilies) {
+            VkDeviceQueueCreateInfo queueCreateInfo{};
+            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            queueCreateInfo.queueFamilyIndex = queueFamily;
+            queueCreateInfo.queueCount = 1;
+            queueCreateInfo.pQueuePriorities = &queuePriority;
+            queueCreateInfos.push_back(queueCreateInfo);
+        }
+
+        VkPhysicalDeviceFeatures deviceFeatures{};
+        deviceFeatures.multiDrawIndirect = VK_TRUE;
+        deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+        //std::vector<const char*> deviceExtensions;
+        if (enableValidationLayers) 
+        {
+          deviceExtensions.push_back(VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME); // needed for macOS
+        }
+        VkDeviceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+
+        VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+        presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+        presentWaitFeatures.presentWait = VK_TRUE;
+
+        VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+        presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+        presentIdFeatures.pNext = &presentWaitFeatures;
+        presentIdFeatures.presentId = VK_TRUE;
+
+        VkPhysicalDeviceVulkan12Features vulkan12Features{};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        vulkan12Features.timelineSemaphore = VK_TRUE;
+        vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+        vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+        vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        // without it each draw group's indirect call uses its full command count
+        drawIndirectCountEnabled = capabilities(physicalDevice).vulkan12Features.drawIndirectCount;
+        vulkan12Features.drawIndirectCount = drawIndirectCountEnabled ? VK_TRUE : VK_FALSE;
+        createInfo.pNext = &vulkan12Features;
+
+        if (config.paceFrames && !config.headless) {
+            presentWaitEnabled = capabilities(physicalDevice).presentWait;
+            if (presentWaitEnabled) {
+                deviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+                deviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+                vulkan12Features.pNext = &presentIdFeatures;
+            } else {
+                std::cerr << "frame pacing requested, but VK_KHR_present_wait is not supported!" << std::endl;
+            }
+        }
+
+        // telemetry falls back to the allocator's own numbers without it
+        memoryBudgetEnabled = capabilities(physicalDevice).hasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        if (memoryBudgetEnabled) {
+            deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
+        // falls back to the render pass without it
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+        dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+        dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+
+        dynamicRenderingEnabled = config.dynamicRendering && capabilities(physicalDevice).dynamicRendering;
+        if (dynamicRenderingEnabled) {
+            deviceExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+            dynamicRenderingFeatures.pNext = const_cast<void*>(createInfo.pNext);
+            createInfo.pNext = &dynamicRenderingFeatures;
+        }
+
+        createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+        createInfo.pQueueCreateInfos = queueCreateInfos.data();
+
+        createInfo.pEnabledFeatures = &deviceFeatures;
+
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+        if (enableValidationLayers) {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+        } else {
+            createInfo.enabledLayerCount = 0;
+        }
+
+        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create logical device!");
+        }
+
+        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
+        if (indices.presentFamily) {
+            vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+        }
+        vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
+
+        std::set<uint32_t> bufferFamilies = {indices.graphicsFamily.value(), indices.transferFamily.value()};
+        bufferQueueFamilies.assign(bufferFamilies.begin(), bufferFamilies.end());
+
+        cullingQueueFamilies = {indices.graphicsFamily.value()};
+        if (asyncComputeEnabled) {
+            vkGetDeviceQueue(device, indices.computeFamily.value(), 0, &computeQueue);
+            cullingQueueFamilies.push_back(indices.computeFamily.value());
+        }
+
+        // made up front, so the other threads only ever look them up
+        queueMutexes[graphicsQueue];
+        queueMutexes[transferQueue];
+        if (indices.presentFamily) {
+            queueMutexes[presentQueue];
+        }
+        if (asyncComputeEnabled) {
+            queueMutexes[computeQueue];
+        }
+
+        if (presentWaitEnabled) {
+            pfnWaitForPresent = (PFN_vkWaitForPresentKHR) vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
+        }
+
+        if (dynamicRenderingEnabled) {
+            pfnCmdBeginRendering = (PFN_vkCmdBeginRenderingKHR) vkGetDeviceProcAddr(device, "vkCmdBeginRenderingKHR");
+            pfnCmdEndRendering = (PFN_vkCmdEndRenderingKHR) vkGetDeviceProcAddr(device, "vkCmdEndRenderingKHR");
+        }
+    }
+
+    // only meaningful on Vulkan 1.2 devices
+    VkPhysicalDeviceVulkan12Features queryVulkan12Features(VkPhysicalDevice device) {
+        VkPhysicalDeviceVulkan12Features vulkan12Features{};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &vulkan12Features;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        vulkan12Features.pNext = nullptr;
+        return vulkan12Features;
+    }
+
+    // timeline semaphores for the upload queue, multi-draw indirect with firstInstance for the batched scene, and
+    // enough descriptor indexing for the bindless set
+    bool supportsRequiredFeatures(VkPhysicalDevice device) {
+        const DeviceCapabilities& caps = capabilities(device);
+        if (caps.properties.apiVersion < VK_API_VERSION_1_2) {
+            return false;
+        }
+
+        const VkPhysicalDeviceFeatures& features = caps.features;
+        const VkPhysicalDeviceVulkan12Features& vulkan12Features = caps.vulkan12Features;
+        bool bindless = vulkan12Features.runtimeDescriptorArray && vulkan12Features.descriptorBindingPartiallyBound &&
+            vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind && vulkan12Features.descriptorBindingUpdateUnusedWhilePending;
+
+        return vulkan12Features.timelineSemaphore && bindless && features.multiDrawIndirect && features.drawIndirectFirstInstance;
+    }
+
+    // the two below run once per device, from queryCapabilities()
+    bool queryPresentWaitSupport(VkPhysicalDevice device, const DeviceCapabilities& caps) {
+        if (caps.properties.apiVersion < VK_API_VERSION_1_1 ||
+            !caps.hasExtension(VK_KHR_PRESENT_ID_EXTENSION_NAME) ||
+            !caps.hasExtension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+            return false;
+        }
+
+        VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+        presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+
+        VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+        presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+        presentIdFeatures.pNext = &presentWaitFeatures;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &presentIdFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        return presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+    }
+
+    bool queryDynamicRenderingSupport(VkPhysicalDevice device, const DeviceCapabilities& caps) {
+        if (!caps.hasExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)) {
+            return false;
+        }
+
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+        dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &dynamicRenderingFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        return dynamicRenderingFeatures.dynamicRendering;
+    }
+
+    // Starts reading the startup shaders in before there is a device to make modules with, so the pipeline
+    // builds' readFile() calls find them in memory, and maps the pipeline cache. A missing shader is left
+    // for its build to report.
+    void preloadStartupFiles() {
+        std::vector<std::string> shaders = {"shaders/vert.spv", "shaders/frag.spv", "shaders/cull.spv", "shaders/depth_pyramid.spv"};
+        if (!config.meshPath.empty()) {
+            shaders.push_back("shaders/mesh.spv");
+        }
+
+        for (const auto& path : shaders) {
+            if (!std::filesystem::exists(path)) {
+                continue;
+            }
+
+            readFile(path).prefetch();
+        }
+
+        if (std::filesystem::exists(PIPELINE_CACHE_PATH)) {
+            preloadedPipelineCache = readFile(PIPELINE_CACHE_PATH);
+            preloadedPipelineCache.prefetch();
+        }
+    }
+
+    void createPipelineCache() {
+        MappedFile cacheData = std::move(preloadedPipelineCache);
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        if (isPipelineCacheCompatible(cacheData)) {
+            cacheInfo.initialDataSize = cacheData.size();
+            cacheInfo.pInitialData = cacheData.data();
+        }
+
+        if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+    }
+
+    // a cache blob written by another driver, GPU or driver version is rejected so the driver never sees it
+    bool isPipelineCacheCompatible(const MappedFile& cacheData) {
+        VkPipelineCacheHeaderVersionOne header{};
+        if (cacheData.size() < sizeof(header)) {
+            return false;
+        }
+        memcpy(&header, cacheData.data(), sizeof(header));
+
+        const VkPhysicalDeviceProperties& properties = capabilities(physicalDevice).properties;
+
+        return header.headerSize >= sizeof(header) &&
+            header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+            header.vendorID == properties.vendorID &&
+            header.deviceID == properties.deviceID &&
+            memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+
+    // write to a temporary file and rename it over the old cache so a crash never leaves a truncated blob behind
+    void savePipelineCache() {
+        size_t cacheSize = 0;
+        if (vkGetPipelineCacheData(device, pipelineCache, &cacheSize, nullptr) != VK_SUCCESS || cacheSize == 0) {
+            return;
+        }
+
+        std::vector<char> cacheData(cacheSize);
+        if (vkGetPipelineCacheData(device, pipelineCache, &cacheSize, cacheData.data()) != VK_SUCCESS) {
+            return;
+        }
+
+        std::string tempPath = std::string(PIPELINE_CACHE_PATH) + ".tmp";
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write(cacheData.data(), cacheSize);
+        file.close();
+
+        std::error_code error;
+        if (file.fail()) {
+            std::filesystem::remove(tempPath, error);
+            std::cerr << "failed to write pipeline cache!" << std::endl;
+            return;
+        }
+
+        std::filesystem::rename(tempPath, PIPELINE_CACHE_PATH, error);
+        if (error) {
+            std::cerr << "failed to replace pipeline cache: " << error.message() << std::endl;
+        }
+    }
+
+    // settled ahead of the swapchain, so the render pass and the pipelines need not wait for it;
+    // createSwapChain() picks the same format from the same cached list
+    void chooseSceneFormat() {
+        if (config.headless) {
+            swapChainImageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+        } else {
+            swapChainImageFormat = chooseSwapSurfaceFormat(capabilities(physicalDevice).surfaceFormats).format;
+        }
+    }
+
+    // The upscale is a linear-filtered blit, so the scene format has to support one both ways and the
+    // swapchain images have to take transfer writes; the scale is driven by the timestamp profiler, which
+    // needs timestamps on the graphics queue.
+    void setupDynamicResolution() {
+        dynamicResolutionEnabled = false;
+        if (config.targetFps == 0.0) {
+            return;
+        }
+
+        const VkFormatFeatureFlags BLIT_FEATURES = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, swapChainImageFormat, &formatProperties);
+        bool blittable = (formatProperties.optimalTilingFeatures & BLIT_FEATURES) == BLIT_FEATURES;
+        if (!config.headless) {
+            blittable = blittable && (querySwapChainSupport(physicalDevice).capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+        }
+
+        const DeviceCapabilities& caps = capabilities(physicalDevice);
+        bool timestamps = caps.queueFamilies[caps.queueFamilyIndices.graphicsFamily.value()].timestampValidBits > 0;
+
+        if (!blittable) {
+            std::cerr << "dynamic resolution requested, but the swapchain images cannot be blit into!" << std::endl;
+        } else if (!timestamps) {
+            std::cerr << "dynamic resolution requested, but timestamp queries are not supported!" << std::endl;
+        } else {
+            dynamicResolutionEnabled = true;
+        }
+    }
+
+    void createSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE) {
+        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+
+        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
+        VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+        swapChainPresentMode = presentMode;
+        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+
+        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+        if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
+            imageCount = swapChainSupport.capabilities.maxImageCount;
+        }
+
+        VkSwapchainCreateInfoKHR createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+        createInfo.surface = surface;
+
+        createInfo.minImageCount = imageCount;
+        createInfo.imageFormat = surfaceFormat.format;
+        createInfo.imageColorSpace = surfaceFormat.colorSpace;
+        createInfo.imageExtent = extent;
+        createInfo.imageArrayLayers = 1;
+        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        if (dynamicResolutionEnabled) {
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        }
+
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+
+        if (indices.graphicsFamily != indices.presentFamily) {
+            createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+            createInfo.queueFamilyIndexCount = 2;
+            createInfo.pQueueFamilyIndices = queueFamilyIndices;
+        } else {
+            createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        }
+
+        createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
+        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+        createInfo.presentMode = presentMode;
+        createInfo.clipped = VK_TRUE;
+        createInfo.oldSwapchain = oldSwapChain;
+
+        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create swap chain!");
+        }
+
+        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
+        swapChainImages.resize(imageCount);
+        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+
+        swapChainImageFormat = surfaceFormat.format;
+        swapChainExtent = extent;
+    }
+
+    void createAllocator() {
+        allocator = std::make_unique<DeviceAllocator>(physicalDevice, device);
+    }
+
+    void createUploadQueue() {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+        uploads.create(device, *allocator, transferQueue, indices.transferFamily.value(), queueMutex(transferQueue));
+    }
+
+    // the copies land on the transfer queue; drawFrame() makes the graphics queue wait for them
+    void createVertexBuffer() {
+        VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+            vertexBuffer, vertexBufferMemory, bufferQueueFamilies);
+        uploads.upload(vertexBuffer, 0, vertices.data(), bufferSize);
+    }
+
+    void createScene() {
+        float boundingRadius = 0.0f;
+        for (const auto& vertex : vertices) {
+            boundingRadius = std::max(boundingRadius, std::sqrt(vertex.pos[0] * vertex.pos[0] + vertex.pos[1] * vertex.pos[1]));
+        }
+
+        triangleMesh = batcher.addMesh({vertexBuffer, indexBuffer, VK_INDEX_TYPE_UINT16, static_cast<uint32_t>(indices.size()), 0, 0, boundingRadius});
+        updateScene();
+    }
+
+    // lays objectCount triangles out on a square grid; one object covers the whole screen
+    void updateScene() {
+        if (sceneObjectCount == objectCount) {
+            return;
+        }
+        sceneObjectCount = objectCount;
+
+        InstanceData& grid = batcher.instances(graphicsPipeline, triangleMesh);
+        grid.resize(objectCount);
+
+        uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(objectCount))));
+        float cellSize = 2.0f / static_cast<float>(columns);
+        for (uint32_t i = 0; i < objectCount; i++) {
+            grid.positionX[i] = (static_cast<float>(i % columns) + 0.5f) * cellSize - 1.0f;
+        }
+        for (uint32_t i = 0; i < objectCount; i++) {
+            grid.positionY[i] = (static_cast<float>(i / columns) + 0.5f) * cellSize - 1.0f;
+        }
+        for (uint32_t i = 0; i < objectCount; i++) {
+            grid.scale[i] = 0.5f * cellSize;
+        }
+        for (uint32_t i = 0; i < objectCount; i++) {
+            grid.rotation[i] = 0.0f;
+        }
+        for (uint32_t i = 0; i < objectCount; i++) {
+            grid.materialId[i] = i % 4;
+        }
+    }
+
+    // only maps the file and sizes the buffers; the contents stream in behind the first frames
+    void createMesh() {
+        if (config.meshPath.empty()) {
+            return;
+        }
+
+        meshStreamer.open(readFile(config.meshPath));
+        const MeshFileHeader& header = meshStreamer.header();
+
+        createBuffer(std::max<VkDeviceSize>(uint64_t(header.vertexCount) * sizeof(PackedVertex), 1),
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+            meshVertexBuffer, meshVertexBufferMemory, bufferQueueFamilies);
+        createBuffer(std::max<VkDeviceSize>(uint64_t(header.indexCount) * header.indexSize, 1),
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+            meshIndexBuffer, meshIndexBufferMemory, bufferQueueFamilies);
+
+        // fit the bounds into the middle of the screen, keeping their proportions
+        float size[3];
+        for (int axis = 0; axis < 3; axis++) {
+            size[axis] = header.boundsMax[axis] - header.boundsMin[axis];
+        }
+        float fit = 1.8f / std::max({size[0], size[1], 1e-6f});
+        for (int axis = 0; axis < 2; axis++) {
+            meshPushConstants.meshScale[axis] = size[axis] * fit;
+            meshPushConstants.meshOffset[axis] = -0.5f * size[axis] * fit;
+        }
+        meshPushConstants.meshScale[2] = 1.0f;
+        meshPushConstants.meshOffset[2] = 0.0f;
+
+        meshStreamer.start(jobs, uploads, meshVertexBuffer, meshIndexBuffer);
+    }
+
+    void createIndexBuffer() {
+        VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+            indexBuffer, indexBufferMemory, bufferQueueFamilies);
+        uploads.upload(indexBuffer, 0, indices.data(), bufferSize);
+    }
+
+    void createMaterials() {
+        VkDeviceSize bufferSize = sizeof(materials[0]) * materials.size();
+
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+            materialBuffer, materialBufferMemory, bufferQueueFamilies);
+        uploads.upload(materialBuffer, 0, materials.data(), bufferSize);
+
+        materialTable = bindless.addBuffer(materialBuffer);
+    }
+
+    void createOffscreenTargets() {
+        swapChainExtent = config.headlessExtent;
+
+        offscreenTargets.resize(config.framesInFlight);
+        swapChainImages.clear();
+
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        if (dynamicResolutionEnabled) {
+            usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        }
+
+        for (auto& target : offscreenTargets) {
+            createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+                usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, target.image, target.memory);
+            swapChainImages.push_back(target.image);
+        }
+    }
+
+    void createImageViews() {
+        swapChainImageViews.resize(swapChainImages.size());
+
+        for (size_t i = 0; i < swapChainImages.size(); i++) {
+            swapChainImageViews[i] = createImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+        }
+    }
+
+    // sized with the swapchain; the pyramid's first level is the largest power of two that fits in the depth buffer
+    void createMultisampleTargets() {
+        if (msaaSamples == VK_SAMPLE_COUNT_1_BIT) {
+            msaaColorImage = VK_NULL_HANDLE;
+            msaaColorView = VK_NULL_HANDLE;
+            msaaDepthImage = VK_NULL_HANDLE;
+            msaaDepthView = VK_NULL_HANDLE;
+            return;
+        }
+
+        createTransientAttachment(swapChainImageFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, msaaColorImage, msaaColorMemory);
+        msaaColorView = createImageView(msaaColorImage, swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        createTransientAttachment(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, msaaDepthImage, msaaDepthMemory);
+        msaaDepthView = createImageView(msaaDepthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+    }
+
+    void createSceneColorTarget() {
+        if (!dynamicResolutionEnabled) {
+            sceneColorImage = VK_NULL_HANDLE;
+            sceneColorView = VK_NULL_HANDLE;
+            return;
+        }
+
+        createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sceneColorImage, sceneColorMemory);
+        sceneColorView = createImageView(sceneColorImage, swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+
+    // lazily allocated memory where the device has it, so a tiled GPU need not back the image at all
+    void createTransientAttachment(VkFormat format, VkImageUsageFlags usage, VkImage& image, MemoryAllocation& imageMemory) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = swapChainExtent.width;
+        imageInfo.extent.height = swapChainExtent.height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        imageInfo.samples = msaaSamples;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create image!");
+        }
+
+        imageMemory = allocator->allocateForImage(image, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+    }
+
+    void createDepthResources() {
+        createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory, 1,
+            cullingQueueFamilies);
+        depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+        renderedDepthExtent = swapChainExtent;
+
+        depthPyramidExtent = {previousPowerOfTwo(swapChainExtent.width), previousPowerOfTwo(swapChainExtent.height)};
+        depthPyramidLevels = 1;
+        while (depthPyramidLevels < MAX_PYRAMID_LEVELS && (std::max(depthPyramidExtent.width, depthPyramidExtent.height) >> depthPyramidLevels) > 0) {
+            depthPyramidLevels++;
+        }
+
+        createImage(depthPyramidExtent.width, depthPyramidExtent.height, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            depthPyramid, depthPyramidMemory, depthPyramidLevels, cullingQueueFamilies);
+        depthPyramidView = createImageView(depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, depthPyramidLevels);
+
+        depthPyramidLevelViews.clear();
+        for (uint32_t level = 0; level < depthPyramidLevels; level++) {
+            depthPyramidLevelViews.push_back(createImageView(depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1));
+        }
+        depthPyramidNeedsClear = true;
+    }
+
+    static uint32_t previousPowerOfTwo(uint32_t value) {
+        uint32_t result = 1;
+        while (result <= value / 2) {
+            result *= 2;
+        }
+        return result;
+    }
+
+    VkExtent2D depthPyramidLevelExtent(uint32_t level) const {
+        return {std::max(depthPyramidExtent.width >> level, 1u), std::max(depthPyramidExtent.height >> level, 1u)};
+    }
+
+    // The scene pass's attachments in render pass order: color and depth, then with MSAA the single-sample
+    // targets they resolve into. Only what is read after the pass is stored; the rest is cleared on load and
+    // dropped at the end, which is what keeps a tiled GPU from writing it out to memory.
+    enum SceneAttachmentIndex : uint32_t {
+        SCENE_COLOR,
+        SCENE_DEPTH,
+        SCENE_COLOR_RESOLVE,
+        SCENE_DEPTH_RESOLVE
+    };
+
+    struct SceneAttachment {
+        VkFormat format;
+        VkSampleCountFlagBits samples;
+        VkImageAspectFlags aspect;
+        VkAttachmentLoadOp loadOp;
+        VkAttachmentStoreOp storeOp;
+        VkImageLayout layout;
+        VkImageLayout finalLayout;
+        VkImage image;
+        VkImageView view;
+    };
+
+    // the readback copy in headless mode, or the upscale blit
+    bool sceneColorReadByTransfer() const {
+        return config.headless || dynamicResolutionEnabled;
+    }
+
+    // images and views are those of the given swapchain image; createRenderPass() only needs the rest
+    std::vector<SceneAttachment> sceneAttachments(std::optional<uint32_t> imageIndex = std::nullopt) const {
+        bool multisampled = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+
+        // presented, read back or blit up, and read by the depth pyramid build
+        VkImageLayout colorFinalLayout = sceneColorReadByTransfer() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        VkImageLayout depthFinalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+        VkImage colorImage = imageIndex ? swapChainImages[imageIndex.value()] : VK_NULL_HANDLE;
+        VkImageView colorView = imageIndex ? swapChainImageViews[imageIndex.value()] : VK_NULL_HANDLE;
+        if (imageIndex && dynamicResolutionEnabled) {
+            colorImage = sceneColorImage;
+            colorView = sceneColorView;
+        }
+        VkImage storedDepthImage = imageIndex ? depthImage : VK_NULL_HANDLE;
+        VkImageView storedDepthView = imageIndex ? depthImageView : VK_NULL_HANDLE;
+
+        std::vector<SceneAttachment> attachments;
+        if (!multisampled) {
+            attachments.push_back({swapChainImageFormat, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_ASPECT_COLOR_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR,
+                VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, colorFinalLayout, colorImage, colorView});
+            attachments.push_back({depthFormat, VK_SAMPLE_COUNT_1_BIT, depthAspectMask(), VK_ATTACHMENT_LOAD_OP_CLEAR,
+                VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, depthFinalLayout, storedDepthImage, storedDepthView});
+            return attachments;
+        }
+
+        attachments.push_back({swapChainImageFormat, msaaSamples, VK_IMAGE_ASPECT_COLOR_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR,
+            VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            msaaColorImage, msaaColorView});
+        attachments.push_back({depthFormat, msaaSamples, depthAspectMask(), VK_ATTACHMENT_LOAD_OP_CLEAR,
+            VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            msaaDepthImage, msaaDepthView});
+
+        // the resolve overwrites every pixel, so there is nothing to load
+        attachments.push_back({swapChainImageFormat, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_ASPECT_COLOR_BIT, VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, colorFinalLayout, colorImage, colorView});
+        attachments.push_back({depthFormat, VK_SAMPLE_COUNT_1_BIT, depthAspectMask(), VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, depthFinalLayout, storedDepthImage, storedDepthView});
+        return attachments;
+    }
+
+    // the highest count up to the requested one that both color and depth attachments support
+    VkSampleCountFlagBits chooseSampleCount(uint32_t requested) {
+        const VkPhysicalDeviceProperties& properties = capabilities(physicalDevice).properties;
+        VkSampleCountFlags supported = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+
+        uint32_t samples = requested;
+        while (samples > 1 && !(supported & samples)) {
+            samples /= 2;
+        }
+
+        if (samples != requested) {
+            std::cerr << requested << "x MSAA is not supported, using " << samples << "x!" << std::endl;
+        }
+
+        return static_cast<VkSampleCountFlagBits>(samples);
+    }
+
+    void createRenderPass() {
+        depthFormat = findDepthFormat();
+        msaaSamples = chooseSampleCount(config.msaaSamples);
+
+        // recordRenderPass() does the layout transitions and dependencies below with barriers instead
+        if (dynamicRenderingEnabled) {
+            return;
+        }
+
+        std::vector<SceneAttachment> sceneTargets = sceneAttachments();
+        bool multisampled = sceneTargets.size() > SCENE_COLOR_RESOLVE;
+
+        std::vector<VkAttachmentDescription2> attachments;
+        std::vector<VkAttachmentReference2> references;
+        for (size_t i = 0; i < sceneTargets.size(); i++) {
+            const SceneAttachment& target = sceneTargets[i];
+
+            VkAttachmentDescription2 attachment{};
+            attachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+            attachment.format = target.format;
+            attachment.samples = target.samples;
+            attachment.loadOp = target.loadOp;
+            attachment.storeOp = target.storeOp;
+            attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            attachment.finalLayout = target.finalLayout;
+            attachments.push_back(attachment);
+
+            VkAttachmentReference2 reference{};
+            reference.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+            reference.attachment = static_cast<uint32_t>(i);
+            reference.layout = target.layout;
+            reference.aspectMask = target.aspect;
+            references.push_back(reference);
+        }
+
+        VkSubpassDescription2 subpass{};
+        subpass.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2;
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &references[SCENE_COLOR];
+        subpass.pDepthStencilAttachment = &references[SCENE_DEPTH];
+
+        // the pyramid is built from sample 0 of the resolved depth, which is as conservative as any sample
+        VkSubpassDescriptionDepthStencilResolve depthResolve{};
+        if (multisampled) {
+            subpass.pResolveAttachments = &references[SCENE_COLOR_RESOLVE];
+
+            depthResolve.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_DEPTH_STENCIL_RESOLVE;
+            depthResolve.depthResolveMode = VK_RESOLVE_MODE_SAMPLE_ZERO_BIT;
+            depthResolve.stencilResolveMode = VK_RESOLVE_MODE_NONE;
+            depthResolve.pDepthStencilResolveAttachment = &references[SCENE_DEPTH_RESOLVE];
+            subpass.pNext = &depthResolve;
+        }
+
+        // the stored depth buffer is shared by all frames: the previous frame's depth writes (or resolve) and
+        // pyramid build have to finish before this one clears it
+        std::vector<VkSubpassDependency2> dependencies(1);
+        VkSubpassDependency2& dependency = dependencies[0];
+        dependency.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
+        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependency.dstSubpass = 0;
+        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        if (dynamicResolutionEnabled) {
+            // so is sceneColorImage, which the previous frame's upscale blit reads
+            dependency.srcStageMask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+        }
+
+        // recordDepthPyramid() reads the depth the subpass wrote; resolves count as color attachment writes
+        VkSubpassDependency2 depthPyramidDependency{};
+        depthPyramidDependency.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
+        depthPyramidDependency.srcSubpass = 0;
+        depthPyramidDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+        depthPyramidDependency.srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        depthPyramidDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        depthPyramidDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        depthPyramidDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        dependencies.push_back(depthPyramidDependency);
+
+        if (sceneColorReadByTransfer()) {
+            // the readback copy or the upscale blit in recordCommandBuffer() reads what the subpass wrote
+            VkSubpassDependency2 readback{};
+            readback.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
+            readback.srcSubpass = 0;
+            readback.dstSubpass = VK_SUBPASS_EXTERNAL;
+            readback.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            readback.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            readback.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            readback.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            dependencies.push_back(readback);
+        }
+
+        VkRenderPassCreateInfo2 renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        renderPassInfo.pAttachments = attachments.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        renderPassInfo.pDependencies = dependencies.data();
+
+        if (vkCreateRenderPass2(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create render pass!");
+        }
+    }
+
+    void createPipelineLayout() {
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        // every graphics pipeline shares this layout, however many materials it draws
+        std::array<VkDescriptorSetLayout, 2> setLayouts = {descriptorSetLayout, bindless.layout()};
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+
+        // the culling pass shares the scene's set
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(CullPushConstants);
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+
+        pipelineLayoutInfo.pSetLayouts = &depthPyramidSetLayout;
+        pushConstantRange.size = sizeof(DepthPyramidPushConstants);
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &depthPyramidPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+    }
+
+    // Built up front rather than through the pipeline library: there are only three, and culling runs from
+    // the first frame. cull.comp is built once per pass through its PASS specialization constant.
+    void createComputePipelines() {
+        uint32_t pass = 0;
+        VkSpecializationMapEntry passEntry{};
+        passEntry.constantID = 0;
+        passEntry.offset = 0;
+        passEntry.size = sizeof(pass);
+
+        VkSpecializationInfo specialization{};
+        specialization.mapEntryCount = 1;
+        specialization.pMapEntries = &passEntry;
+        specialization.dataSize = sizeof(pass);
+        specialization.pData = &pass;
+
+        cullInstancesPipeline = createComputePipeline("shaders/cull.spv", cullPipelineLayout, &specialization);
+        pass = 1;
+        writeCommandsPipeline = createComputePipeline("shaders/cull.spv", cullPipelineLayout, &specialization);
+        depthPyramidPipeline = createComputePipeline("shaders/depth_pyramid.spv", depthPyramidPipelineLayout, nullptr);
+    }
+
+    VkPipeline createComputePipeline(const std::string& shaderPath, VkPipelineLayout layout, const VkSpecializationInfo* specialization) {
+        VkPipelineShaderStageCreateInfo stageInfo{};
+        stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        stageInfo.module = shaderModules->get(readFile(shaderPath));
+        stageInfo.pName = "main";
+        stageInfo.pSpecializationInfo = specialization;
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = stageInfo;
+        pipelineInfo.layout = layout;
+
+        VkPipeline pipeline;
+        if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute pipeline!");
+        }
+
+        return pipeline;
+    }
+
+    void createPipelines() {
+        shaderModules = std::make_unique<ShaderModuleCache>(device);
+        pipelineLibrary = std::make_unique<PipelineLibrary>(device, jobs, [this](const PipelineDescription& description) {
+            return buildGraphicsPipeline(description);
+        });
+
+        PipelineDescription triangle{};
+        triangle.vertShader = "shaders/vert.spv";
+        triangle.fragShader = "shaders/frag.spv";
+        triangle.vertSource = "shaders/shader.vert";
+        triangle.fragSource = "shaders/shader.frag";
+        triangle.renderPass = renderPass;
+        triangle.colorFormat = swapChainImageFormat;
+        triangle.depthFormat = depthFormat;
+        triangle.samples = msaaSamples;
+
+        graphicsPipeline = pipelineLibrary->add(triangle);
+
+        if (enableShaderHotReload) {
+            shaderWatcher.watch(triangle.vertSource, triangle.vertShader);
+            shaderWatcher.watch(triangle.fragSource, triangle.fragShader);
+        }
+
+        // text over the scene in the same pass: blended, no depth, quads of either winding
+        PipelineDescription overlay = triangle;
+        overlay.vertShader = "shaders/overlay_vert.spv";
+        overlay.fragShader = "shaders/overlay_frag.spv";
+        overlay.vertSource = "shaders/overlay.vert";
+        overlay.fragSource = "shaders/overlay.frag";
+        overlay.vertexLayout = VertexLayout::None;
+        overlay.cullMode = VK_CULL_MODE_NONE;
+        overlay.blendEnable = true;
+        overlay.depthTest = false;
+
+        overlayPipeline = pipelineLibrary->add(overlay);
+
+        if (enableShaderHotReload) {
+            shaderWatcher.watch(overlay.vertSource, overlay.vertShader);
+            shaderWatcher.watch(overlay.fragSource, overlay.fragShader);
+        }
+
+        if (!config.meshPath.empty()) {
+            PipelineDescription mesh = triangle;
+            mesh.vertShader = "shaders/mesh.spv";
+            mesh.vertSource = "shaders/mesh.vert";
+            mesh.vertexLayout = VertexLayout::PackedMesh;
+
+            meshPipeline = pipelineLibrary->add(mesh);
+
+            if (enableShaderHotReload) {
+                shaderWatcher.watch(mesh.vertSource, mesh.vertShader);
+            }
+        }
+    }
+
+    void createGpuProfiler() {
+        if (!enableGpuProfiling && !dynamicResolutionEnabled) {
+            return;
+        }
+
+        const DeviceCapabilities& caps = capabilities(physicalDevice);
+        uint32_t timestampValidBits = caps.queueFamilies[caps.queueFamilyIndices.graphicsFamily.value()].timestampValidBits;
+
+        gpuProfiler = std::make_unique<GpuProfiler>(device, caps.properties.limits.timestampPeriod, timestampValidBits,
+            static_cast<uint32_t>(frames.size()));
+    }
+
+    void createShaderWatcher() {
+        if (enableShaderHotReload) {
+            shaderWatcher.start(jobs);
+        }
+    }
+
+    // called at the top of a frame, once the graphics timeline says which submissions have completed
+    void updatePipelines() {
+        shaderWatcher.update();
+        for (const auto& spirvPath : shaderWatcher.takeCompiled()) {
+            pipelineLibrary->reloadShader(spirvPath);
+        }
+
+        pipelineLibrary->swapPending([this](VkPipeline pipeline) {
+            deletionQueue.push(submittedSerial, [this, pipeline] { vkDestroyPipeline(device, pipeline, nullptr); });
+        });
+    }
+
+    // runs as a background task; only touches the device, the pipeline cache and the shared pipeline layout
+    VkPipeline buildGraphicsPipeline(const PipelineDescription& description) {
+        TRACE_SCOPE("build pipeline");
+
+        VkShaderModule vertShaderModule = shaderModules->get(readFile(description.vertShader));
+        VkShaderModule fragShaderModule = shaderModules->get(readFile(description.fragShader));
+
+        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertShaderStageInfo.module = vertShaderModule;
+        vertShaderStageInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        fragShaderStageInfo.module = fragShaderModule;
+        fragShaderStageInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        VkVertexInputBindingDescription bindingDescription{};
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+        if (description.vertexLayout == VertexLayout::PackedMesh) {
+            auto packedAttributes = PackedVertex::getAttributeDescriptions();
+            bindingDescription = PackedVertex::getBindingDescription();
+            attributeDescriptions.assign(packedAttributes.begin(), packedAttributes.end());
+        } else if (description.vertexLayout == VertexLayout::Basic) {
+            auto basicAttributes = Vertex::getAttributeDescriptions();
+            bindingDescription = Vertex::getBindingDescription();
+            attributeDescriptions.assign(basicAttributes.begin(), basicAttributes.end());
+        }
+
+        vertexInputInfo.vertexBindingDescriptionCount = description.vertexLayout == VertexLayout::None ? 0 : 1;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = description.polygonMode;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = description.cullMode;
+        rasterizer.frontFace = description.frontFace;
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = description.samples;
+
+        // less-or-equal keeps the draw order deciding between the scene's triangles, which all sit at depth 0
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = description.depthTest ? VK_TRUE : VK_FALSE;
+        depthStencil.depthWriteEnable = description.depthTest ? VK_TRUE : VK_FALSE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        if (description.blendEnable) {
+            colorBlendAttachment.blendEnable = VK_TRUE;
+            colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+            colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+            colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+            colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+            colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+            colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+        } else {
+            colorBlendAttachment.blendEnable = VK_FALSE;
+        }
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &colorBlendAttachment;
+        colorBlending.blendConstants[0] = 0.0f;
+        colorBlending.blendConstants[1] = 0.0f;
+        colorBlending.blendConstants[2] = 0.0f;
+        colorBlending.blendConstants[3] = 0.0f;
+
+        std::vector<VkDynamicState> dynamicStates = {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR
+        };
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicState.pDynamicStates = dynamicStates.data();
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = shaderStages;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.renderPass = description.renderPass;
+        pipelineInfo.subpass = description.subpass;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+        VkPipelineRenderingCreateInfoKHR renderingInfo{};
+        if (description.renderPass == VK_NULL_HANDLE) {
+            renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+            renderingInfo.colorAttachmentCount = 1;
+            renderingInfo.pColorAttachmentFormats = &description.colorFormat;
+            renderingInfo.depthAttachmentFormat = description.depthFormat;
+            pipelineInfo.pNext = &renderingInfo;
+        }
+
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+
+        return pipeline;
+    }
+
+    void createFramebuffers() {
+        if (dynamicRenderingEnabled) {
+            return;
+        }
+
+        swapChainFramebuffers.resize(swapChainImageViews.size());
+
+        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+            std::vector<VkImageView> attachments;
+            for (const SceneAttachment& target : sceneAttachments(static_cast<uint32_t>(i))) {
+                attachments.push_back(target.view);
+            }
+
+            VkFramebufferCreateInfo framebufferInfo{};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = renderPass;
+            framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+            framebufferInfo.pAttachments = attachments.data();
+            framebufferInfo.width = swapChainExtent.width;
+            framebufferInfo.height = swapChainExtent.height;
+            framebufferInfo.layers = 1;
+
+            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create framebuffer!");
+            }
+        }
+    }
+
+    void createFrameContexts() {
+        frames.resize(config.framesInFlight);
+    }
+
+    // set 0 of the scene: shader.vert reads the instances and the visible list, cull.comp everything
+    void createDescriptorSetLayout() {
+        std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+        for (uint32_t i = 0; i < 4; i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        bindings[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+        bindings[1].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+
+        bindings[4].binding = 4;
+        bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[4].descriptorCount = 1;
+        bindings[4].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+
+        // one set per pyramid level: the level below (or the depth buffer) in, this level out
+        std::array<VkDescriptorSetLayoutBinding, 2> pyramidBindings{};
+        pyramidBindings[0].binding = 0;
+        pyramidBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pyramidBindings[0].descriptorCount = 1;
+        pyramidBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pyramidBindings[1].binding = 1;
+        pyramidBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        pyramidBindings[1].descriptorCount = 1;
+        pyramidBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        layoutInfo.bindingCount = static_cast<uint32_t>(pyramidBindings.size());
+        layoutInfo.pBindings = pyramidBindings.data();
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &depthPyramidSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+    }
+
+    // as many buffers as the device takes, up to MAX_BUFFERS, leaving room for set 0's
+    void createBindlessDescriptors() {
+        VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+        indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &indexingProperties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        const uint32_t SCENE_SET_BUFFERS = 4;
+        uint32_t limit = std::min(indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+            indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers);
+        bindless.create(device, std::min(BindlessDescriptors::MAX_BUFFERS, limit - SCENE_SET_BUFFERS));
+    }
+
+    void createDepthSampler() {
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+        if (vkCreateSampler(device, &samplerInfo, nullptr, &depthSampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create depth sampler!");
+        }
+    }
+
+    void createDescriptorPool() {
+        std::array<VkDescriptorPoolSize, 2> poolSizes{};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[0].descriptorCount = static_cast<uint32_t>(frames.size()) * 4;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSizes[1].descriptorCount = static_cast<uint32_t>(frames.size());
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = static_cast<uint32_t>(frames.size());
+
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor pool!");
+        }
+    }
+
+    // one pool per depth buffer, retired along with it, since frames in flight may still use the old sets
+    void createDepthPyramidDescriptorPool() {
+        std::array<VkDescriptorPoolSize, 2> poolSizes{};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSizes[0].descriptorCount = MAX_PYRAMID_LEVELS;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        poolSizes[1].descriptorCount = MAX_PYRAMID_LEVELS;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = MAX_PYRAMID_LEVELS;
+
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &depthPyramidDescriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor pool!");
+        }
+    }
+
+    // the buffer bindings stay empty until uploadInstances() gives each frame its buffers
+    void createDescriptorSets() {
+        std::vector<VkDescriptorSetLayout> layouts(frames.size(), descriptorSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+        allocInfo.pSetLayouts = layouts.data();
+
+        std::vector<VkDescriptorSet> descriptorSets(frames.size());
+        if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate descriptor sets!");
+        }
+        for (size_t i = 0; i < frames.size(); i++) {
+            frames[i].descriptorSet = descriptorSets[i];
+        }
+
+        updateDepthPyramidDescriptors();
+    }
+
+    // points the pyramid build and every frame's culling pass at the current depth resources
+    void updateDepthPyramidDescriptors() {
+        createDepthPyramidDescriptorPool();
+
+        std::vector<VkDescriptorSetLayout> layouts(depthPyramidLevels, depthPyramidSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = depthPyramidDescriptorPool;
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+        allocInfo.pSetLayouts = layouts.data();
+
+        depthPyramidSets.resize(depthPyramidLevels);
+        if (vkAllocateDescriptorSets(device, &allocInfo, depthPyramidSets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate descriptor sets!");
+        }
+
+        for (uint32_t level = 0; level < depthPyramidLevels; level++) {
+            VkDescriptorImageInfo sourceInfo{};
+            sourceInfo.sampler = depthSampler;
+            sourceInfo.imageView = level == 0 ? depthImageView : depthPyramidLevelViews[level - 1];
+            sourceInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+            VkDescriptorImageInfo destinationInfo{};
+            destinationInfo.imageView = depthPyramidLevelViews[level];
+            destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[0].dstSet = depthPyramidSets[level];
+            descriptorWrites[0].dstBinding = 0;
+            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptorWrites[0].descriptorCount = 1;
+            descriptorWrites[0].pImageInfo = &sourceInfo;
+            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[1].dstSet = depthPyramidSets[level];
+            descriptorWrites[1].dstBinding = 1;
+            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            descriptorWrites[1].descriptorCount = 1;
+            descriptorWrites[1].pImageInfo = &destinationInfo;
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        }
+    }
+
+    // Each frame's set may be in flight when the pyramid is recreated, so it is pointed at the new pyramid
+    // only once that frame comes around again and has retired.
+    void updateFrameDepthPyramid(FrameContext& frame) {
+        if (frame.depthPyramidView == depthPyramidView) {
+            return;
+        }
+        frame.depthPyramidView = depthPyramidView;
+
+        VkDescriptorImageInfo pyramidInfo{};
+        pyramidInfo.sampler = depthSampler;
+        pyramidInfo.imageView = depthPyramidView;
+        pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = frame.descriptorSet;
+        descriptorWrite.dstBinding = 4;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &pyramidInfo;
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+    }
+
+    // the indirect buffer holds a draw count per group, then the commands, then a survivor counter per batch
+    static VkDeviceSize indirectCommandsOffset(uint32_t capacity) {
+        return (static_cast<VkDeviceSize>(capacity) * sizeof(uint32_t) + 15) & ~VkDeviceSize(15);
+    }
+
+    static VkDeviceSize indirectCountersOffset(uint32_t capacity) {
+        return indirectCommandsOffset(capacity) + static_cast<VkDeviceSize>(capacity) * sizeof(VkDrawIndexedIndirectCommand);
+    }
+
+    void updateDrawGroups() {
+        if (drawGroupsVersion == batcher.version()) {
+            return;
+        }
+        drawGroupsVersion = batcher.version();
+
+        drawGroups.clear();
+        const auto& batches = batcher.batches();
+        for (uint32_t i = 0; i < batches.size(); i++) {
+            const MeshRange& mesh = batcher.mesh(batches[i].mesh);
+            if (!drawGroups.empty()) {
+                DrawGroup& last = drawGroups.back();
+                const MeshRange& lastMesh = batcher.mesh(last.mesh);
+                if (last.pipeline == batches[i].pipeline && lastMesh.vertexBuffer == mesh.vertexBuffer && lastMesh.indexBuffer == mesh.indexBuffer) {
+                    last.commandCount++;
+                    continue;
+                }
+            }
+            drawGroups.push_back({batches[i].pipeline, batches[i].mesh, i, 1});
+        }
+    }
+
+    void destroyInstanceBuffers(FrameContext& frame) {
+        if (frame.instanceBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, frame.instanceBuffer, nullptr);
+            allocator->free(frame.instanceMemory);
+            vkDestroyBuffer(device, frame.visibleBuffer, nullptr);
+            allocator->free(frame.visibleMemory);
+        }
+    }
+
+    void destroyBatchBuffers(FrameContext& frame) {
+        if (frame.batchBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, frame.batchBuffer, nullptr);
+            allocator->free(frame.batchMemory);
+            vkDestroyBuffer(device, frame.indirectBuffer, nullptr);
+            allocator->free(frame.indirectMemory);
+        }
+    }
+
+    void updateSceneDescriptors(FrameContext& frame) {
+        std::array<VkDescriptorBufferInfo, 4> bufferInfos{};
+        bufferInfos[0] = {frame.instanceBuffer, 0, VK_WHOLE_SIZE};
+        bufferInfos[1] = {frame.visibleBuffer, 0, VK_WHOLE_SIZE};
+        bufferInfos[2] = {frame.batchBuffer, 0, VK_WHOLE_SIZE};
+        bufferInfos[3] = {frame.indirectBuffer, 0, VK_WHOLE_SIZE};
+
+        std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
+        for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+            descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[i].dstSet = frame.descriptorSet;
+            descriptorWrites[i].dstBinding = i;
+            descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[i].descriptorCount = 1;
+            descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+
+    // Copies the batched scene into this frame's instance and batch buffers, which the culling pass turns
+    // into draws. The frame has retired, so nothing on the GPU reads them; a frame whose copy is
+    // current skips all of this.
+    void uploadInstances(FrameContext& frame) {
+        if (frame.sceneVersion == batcher.version()) {
+            return;
+        }
+        frame.sceneVersion = batcher.version();
+        updateDrawGroups();
+
+        const auto& batches = batcher.batches();
+        frame.instanceCount = batcher.instanceCount();
+        frame.batchCount = static_cast<uint32_t>(batches.size());
+        uint32_t instanceCount = std::max(batcher.instanceCount(), 1u);
+        uint32_t batchCount = std::max(static_cast<uint32_t>(batches.size()), 1u);
+        bool buffersChanged = false;
+
+        // the CPU-written buffers are host-visible so the writes land in place, device-local where that is on
+        // offer; the GPU-written ones are plain device-local
+        if (instanceCount > frame.instanceCapacity) {
+            destroyInstanceBuffers(frame);
+            frame.instanceCapacity = std::max({instanceCount, frame.instanceCapacity * 2, 256u});
+            createBuffer(static_cast<VkDeviceSize>(frame.instanceCapacity) * InstanceData::COLUMN_COUNT * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.instanceBuffer, frame.instanceMemory,
+                cullingQueueFamilies);
+            createBuffer(static_cast<VkDeviceSize>(frame.instanceCapacity) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, frame.visibleBuffer, frame.visibleMemory, cullingQueueFamilies);
+            buffersChanged = true;
+        }
+
+        if (batchCount > frame.indirectCapacity) {
+            destroyBatchBuffers(frame);
+            frame.indirectCapacity = std::max({batchCount, frame.indirectCapacity * 2, 16u});
+            createBuffer(static_cast<VkDeviceSize>(frame.indirectCapacity) * sizeof(GpuDrawBatch), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.batchBuffer, frame.batchMemory,
+                cullingQueueFamilies);
+            VkDeviceSize size = indirectCountersOffset(frame.indirectCapacity) + static_cast<VkDeviceSize>(frame.indirectCapacity) * sizeof(uint32_t);
+            createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, frame.indirectBuffer, frame.indirectMemory, cullingQueueFamilies);
+            buffersChanged = true;
+        }
+
+        if (buffersChanged) {
+            updateSceneDescriptors(frame);
+        }
+
+        // column k starts at k * instanceCapacity; every batch's instances follow the previous batch's
+        float* columns = static_cast<float*>(frame.instanceMemory.data);
+        size_t stride = frame.instanceCapacity;
+        size_t firstInstance = 0;
+        for (const auto& batch : batches) {
+            const InstanceData& instances = batch.instances;
+            size_t count = instances.size();
+            std::memcpy(columns + 0 * stride + firstInstance, instances.positionX.data(), count * sizeof(float));
+            std::memcpy(columns + 1 * stride + firstInstance, instances.positionY.data(), count * sizeof(float));
+            std::memcpy(columns + 2 * stride + firstInstance, instances.scale.data(), count * sizeof(float));
+            std::memcpy(columns + 3 * stride + firstInstance, instances.rotation.data(), count * sizeof(float));
+            std::memcpy(columns + 4 * stride + firstInstance, instances.materialId.data(), count * sizeof(uint32_t));
+            firstInstance += count;
+        }
+        Telemetry::instance().add(Telemetry::BytesUploaded,
+            firstInstance * InstanceData::COLUMN_COUNT * sizeof(float) + batches.size() * sizeof(GpuDrawBatch));
+
+        auto* gpuBatches = static_cast<GpuDrawBatch*>(frame.batchMemory.data);
+        firstInstance = 0;
+        for (uint32_t group = 0; group < drawGroups.size(); group++) {
+            const DrawGroup& drawGroup = drawGroups[group];
+            for (uint32_t i = drawGroup.firstCommand; i < drawGroup.firstCommand + drawGroup.commandCount; i++) {
+                const MeshRange& mesh = batcher.mesh(batches[i].mesh);
+                uint32_t count = static_cast<uint32_t>(batches[i].instances.size());
+                gpuBatches[i] = {mesh.indexCount, mesh.firstIndex, mesh.vertexOffset, static_cast<uint32_t>(firstInstance), count, group,
+                    drawGroup.firstCommand, mesh.boundingRadius};
+                firstInstance += count;
+            }
+        }
+    }
+
+    // one pool per frame, reset as a whole when the frame comes around again instead of per command buffer
+    void createCommandPools() {
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+        for (auto& frame : frames) {
+            if (vkCreateCommandPool(device, &poolInfo, nullptr, &frame.commandPool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create command pool!");
+            }
+
+            frame.workerPools.resize(jobs.workerCount());
+            for (auto& workerPool : frame.workerPools) {
+                if (vkCreateCommandPool(device, &poolInfo, nullptr, &workerPool.commandPool) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create command pool!");
+                }
+            }
+        }
+
+        if (!asyncComputeEnabled) {
+            return;
+        }
+
+        poolInfo.queueFamilyIndex = queueFamilyIndices.computeFamily.value();
+        for (auto& frame : frames) {
+            if (vkCreateCommandPool(device, &poolInfo, nullptr, &frame.computeCommandPool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create command pool!");
+            }
+        }
+    }
+
+    // the frame has retired, so every buffer from its pools can be reset at once
+    void resetCommandPools(FrameContext& frame) {
+        vkResetCommandPool(device, frame.commandPool, 0);
+        if (frame.computeCommandPool != VK_NULL_HANDLE) {
+            vkResetCommandPool(device, frame.computeCommandPool, 0);
+        }
+        for (auto& workerPool : frame.workerPools) {
+            vkResetCommandPool(device, workerPool.commandPool, 0);
+            workerPool.usedSecondaries = 0;
+        }
+    }
+
+    // only ever called from the worker that owns the pool
+    VkCommandBuffer acquireSecondary(WorkerCommandPool& workerPool) {
+        if (workerPool.usedSecondaries == workerPool.secondaries.size()) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = workerPool.commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+
+            VkCommandBuffer secondary;
+            if (vkAllocateCommandBuffers(device, &allocInfo, &secondary) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate command buffers!");
+            }
+            workerPool.secondaries.push_back(secondary);
         }
 
-        createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
-        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-        createInfo.presentMode = presentMode;
-        createInfo.clipped = VK_TRUE;
+        return workerPool.secondaries[workerPool.usedSecondaries++];
+    }
 
-        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create swap chain!");
+    void createCommandBuffers() {
+        for (auto& frame : frames) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = frame.commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(device, &allocInfo, &frame.commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate command buffers!");
+            }
+
+            if (frame.computeCommandPool != VK_NULL_HANDLE) {
+                allocInfo.commandPool = frame.computeCommandPool;
+                if (vkAllocateCommandBuffers(device, &allocInfo, &frame.computeCommandBuffer) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to allocate command buffers!");
+                }
+            }
         }
+    }
 
-        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
-        swapChainImages.resize(imageCount);
-        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-        swapChainImageFormat = surfaceFormat.format;
-        swapChainExtent = extent;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+
+        // with async compute the slot's queries were reset on the compute queue, which runs first
+        bool asyncCulling = frames[currentFrame].computeRecorded;
+        if (gpuProfiler && !asyncCulling) {
+            gpuProfiler->beginFrame(commandBuffer, currentFrame);
+        }
+
+        {
+            GPU_PROFILE_SCOPE(gpuProfiler.get(), commandBuffer, "frame");
+
+            bool culling = cullingActive() && !asyncCulling;
+            if (culling) {
+                recordCulling(commandBuffer);
+            }
+
+            recordRenderPass(commandBuffer, imageIndex);
+
+            if (dynamicResolutionEnabled) {
+                GPU_PROFILE_SCOPE(gpuProfiler.get(), commandBuffer, "upscale");
+                recordUpscale(commandBuffer, imageIndex);
+            }
+
+            if (culling) {
+                recordDepthPyramid(commandBuffer);
+            }
+
+            if (config.headless) {
+                GPU_PROFILE_SCOPE(gpuProfiler.get(), commandBuffer, "readback");
+                recordReadback(commandBuffer, imageIndex);
+            }
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record command buffer!");
+        }
     }
 
-    void createImageViews() {
-        swapChainImageViews.resize(swapChainImages.size());
+    // Async compute: the depth pyramid from the previous frame's depth buffer, then culling against it. On
+    // the graphics queue the pyramid is built at the end of a frame instead; either way culling sees the
+    // previous frame's depth.
+    void recordComputeCommandBuffer(VkCommandBuffer commandBuffer) {
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-        for (size_t i = 0; i < swapChainImages.size(); i++) {
-            VkImageViewCreateInfo createInfo{};
-            createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-            createInfo.image = swapChainImages[i];
-            createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-            createInfo.format = swapChainImageFormat;
-            createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            createInfo.subresourceRange.baseMipLevel = 0;
-            createInfo.subresourceRange.levelCount = 1;
-            createInfo.subresourceRange.baseArrayLayer = 0;
-            createInfo.subresourceRange.layerCount = 1;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+
+        if (gpuProfiler) {
+            gpuProfiler->beginFrame(commandBuffer, currentFrame);
+        }
+
+        {
+            GPU_PROFILE_SCOPE(gpuProfiler.get(), commandBuffer, "async compute");
 
-            if (vkCreateImageView(device, &createInfo, nullptr, &swapChainImageViews[i]) != VK_SUCCESS) {
-                throw std::runtime_error("failed to create image views!");
+            // a new depth buffer holds no frame yet; recordCulling() clears the pyramid instead
+            if (!depthPyramidNeedsClear) {
+                recordDepthPyramid(commandBuffer);
             }
+            recordCulling(commandBuffer);
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record command buffer!");
         }
     }
 
-    void createRenderPass() {
-        VkAttachmentDescription colorAttachment{};
-        colorAttachment.format = swapChainImageFormat;
-        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-        VkAttachmentReference colorAttachmentRef{};
-        colorAttachmentRef.attachment = 0;
-        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-        VkSubpassDescription subpass{};
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 1;
-        subpass.pColorAttachments = &colorAttachmentRef;
+    // the batched scene is the only thing culled; direct draws are the unculled baseline
+    bool cullingActive() const {
+        return meshPipeline == INVALID_PIPELINE_HANDLE && !directDraws;
+    }
 
-        VkSubpassDependency dependency{};
-        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependency.dstSubpass = 0;
-        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.srcAccessMask = 0;
-        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-        VkRenderPassCreateInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassInfo.attachmentCount = 1;
-        renderPassInfo.pAttachments = &colorAttachment;
-        renderPassInfo.subpassCount = 1;
-        renderPassInfo.pSubpasses = &subpass;
-        renderPassInfo.dependencyCount = 1;
-        renderPassInfo.pDependencies = &dependency;
+    // Culls the batched scene against the screen and the previous frame's depth pyramid, then writes an
+    // indirect command for each batch with survivors into this frame's indirect buffer.
+    void recordCulling(VkCommandBuffer commandBuffer) {
+        GPU_PROFILE_SCOPE(gpuProfiler.get(), commandBuffer, "culling");
+        const FrameContext& frame = frames[currentFrame];
 
-        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create render pass!");
+        if (depthPyramidNeedsClear) {
+            clearDepthPyramid(commandBuffer);
+            depthPyramidNeedsClear = false;
+        }
+
+        vkCmdFillBuffer(commandBuffer, frame.indirectBuffer, 0, indirectCommandsOffset(frame.indirectCapacity), 0);
+        vkCmdFillBuffer(commandBuffer, frame.indirectBuffer, indirectCountersOffset(frame.indirectCapacity),
+            static_cast<VkDeviceSize>(frame.indirectCapacity) * sizeof(uint32_t), 0);
+
+        // covers the fills and the previous frame's pyramid build
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
+
+        CullPushConstants pushConstants{};
+        pushConstants.instanceStride = frame.instanceCapacity;
+        pushConstants.instanceCount = frame.instanceCount;
+        pushConstants.batchCount = frame.batchCount;
+        pushConstants.commandsOffset = static_cast<uint32_t>(indirectCommandsOffset(frame.indirectCapacity) / sizeof(uint32_t));
+        pushConstants.countersOffset = static_cast<uint32_t>(indirectCountersOffset(frame.indirectCapacity) / sizeof(uint32_t));
+        pushConstants.compactDraws = drawIndirectCountEnabled ? 1 : 0;
+        pushConstants.pyramidLevels = depthPyramidLevels;
+        pushConstants.pyramidSize[0] = static_cast<float>(depthPyramidExtent.width);
+        pushConstants.pyramidSize[1] = static_cast<float>(depthPyramidExtent.height);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+        const uint32_t GROUP_SIZE = 64;
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullInstancesPipeline);
+        vkCmdDispatch(commandBuffer, (frame.instanceCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, writeCommandsPipeline);
+        vkCmdDispatch(commandBuffer, (frame.batchCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+        // on the compute queue the graphics submit's semaphore wait covers this
+        if (frame.computeRecorded) {
+            return;
         }
+
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
     }
 
-    void createGraphicsPipeline() {
-        auto vertShaderCode = readFile("shaders/vert.spv");
-        auto fragShaderCode = readFile("shaders/frag.spv");
+    // a fresh pyramid reads as the far plane everywhere, so the first culled frame only drops what is off screen
+    void clearDepthPyramid(VkCommandBuffer commandBuffer) {
+        VkImageSubresourceRange range{};
+        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        range.baseMipLevel = 0;
+        range.levelCount = depthPyramidLevels;
+        range.baseArrayLayer = 0;
+        range.layerCount = 1;
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = depthPyramid;
+        barrier.subresourceRange = range;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkClearColorValue farPlane = {{1.0f, 1.0f, 1.0f, 1.0f}};
+        vkCmdClearColorImage(commandBuffer, depthPyramid, VK_IMAGE_LAYOUT_GENERAL, &farPlane, 1, &range);
+    }
 
-        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+    // reduces this frame's depth into the pyramid the next frame culls against, one level per dispatch
+    void recordDepthPyramid(VkCommandBuffer commandBuffer) {
+        GPU_PROFILE_SCOPE(gpuProfiler.get(), commandBuffer, "depth pyramid");
+
+        // the culling pass is done reading the previous pyramid
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipeline);
+
+        const uint32_t GROUP_SIZE = 8;
+        for (uint32_t level = 0; level < depthPyramidLevels; level++) {
+            VkExtent2D source = level == 0 ? renderedDepthExtent : depthPyramidLevelExtent(level - 1);
+            VkExtent2D destination = depthPyramidLevelExtent(level);
+
+            DepthPyramidPushConstants pushConstants{};
+            pushConstants.sourceSize[0] = source.width;
+            pushConstants.sourceSize[1] = source.height;
+            pushConstants.destinationSize[0] = destination.width;
+            pushConstants.destinationSize[1] = destination.height;
+
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipelineLayout, 0, 1, &depthPyramidSets[level], 0, nullptr);
+            vkCmdPushConstants(commandBuffer, depthPyramidPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+            vkCmdDispatch(commandBuffer, (destination.width + GROUP_SIZE - 1) / GROUP_SIZE, (destination.height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+    }
 
-        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vertShaderStageInfo.module = vertShaderModule;
-        vertShaderStageInfo.pName = "main";
+    // Scene recording is cut into jobs that each record a secondary command buffer from their worker's own
+    // pool. The primary executes them in job order, so the draw order is the same as recording on one thread.
+    void recordRenderPass(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        GPU_PROFILE_SCOPE(gpuProfiler.get(), commandBuffer, "render pass");
+        renderedDepthExtent = renderExtent;
 
-        VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        fragShaderStageInfo.module = fragShaderModule;
-        fragShaderStageInfo.pName = "main";
+        std::array<VkClearValue, 2> clearValues{};
+        clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+        clearValues[1].depthStencil = {1.0f, 0};
 
-        VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+        if (dynamicRenderingEnabled) {
+            beginDynamicRendering(commandBuffer, imageIndex, clearValues);
+        } else {
+            VkRenderPassBeginInfo renderPassInfo{};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassInfo.renderPass = renderPass;
+            renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+            renderPassInfo.renderArea.offset = {0, 0};
+            renderPassInfo.renderArea.extent = renderExtent;
+            renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+            renderPassInfo.pClearValues = clearValues.data();
+
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        }
 
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 0;
-        vertexInputInfo.vertexAttributeDescriptionCount = 0;
+        // direct draws come in slices big enough to be worth a job, and a few jobs per worker so stealing
+        // has something to even out; draw groups are few, so they are spread one slice per worker
+        const uint32_t MIN_DRAWS_PER_JOB = 256;
+        const uint32_t JOBS_PER_WORKER = 4;
+
+        uint32_t jobCount;
+        std::function<void(VkCommandBuffer, uint32_t)> recordSlice;
+        if (meshPipeline != INVALID_PIPELINE_HANDLE) {
+            jobCount = 1;
+            recordSlice = [this](VkCommandBuffer secondary, uint32_t) { recordMeshDraw(secondary); };
+        } else if (directDraws) {
+            uint32_t drawCount = frames[currentFrame].instanceCount;
+            uint32_t drawsPerJob = std::max(MIN_DRAWS_PER_JOB, (drawCount + jobs.workerCount() * JOBS_PER_WORKER - 1) / (jobs.workerCount() * JOBS_PER_WORKER));
+            jobCount = (drawCount + drawsPerJob - 1) / drawsPerJob;
+            recordSlice = [this, drawCount, drawsPerJob](VkCommandBuffer secondary, uint32_t job) {
+                recordDirectDraws(secondary, job * drawsPerJob, std::min(drawCount, (job + 1) * drawsPerJob));
+            };
+        } else {
+            uint32_t groupCount = static_cast<uint32_t>(drawGroups.size());
+            jobCount = std::min(groupCount, jobs.workerCount());
+            uint32_t groupsPerJob = jobCount == 0 ? 0 : (groupCount + jobCount - 1) / jobCount;
+            recordSlice = [this, groupCount, groupsPerJob](VkCommandBuffer secondary, uint32_t job) {
+                recordDrawGroups(secondary, job * groupsPerJob, std::min(groupCount, (job + 1) * groupsPerJob));
+            };
+        }
 
-        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        inputAssembly.primitiveRestartEnable = VK_FALSE;
+        // hidden again so a failed build is reported once per F3 rather than skipped without a word every frame
+        if (overlayVisible && pipelineLibrary->isFailed(overlayPipeline)) {
+            std::cerr << "overlay pipeline failed to build, hiding the overlay" << std::endl;
+            overlayVisible = false;
+        }
 
-        VkPipelineViewportStateCreateInfo viewportState{};
-        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewportState.viewportCount = 1;
-        viewportState.scissorCount = 1;
+        // the overlay is one more job, and its secondary executes last so the text lands on top
+        uint32_t overlayJob = jobCount;
+        if (overlayVisible && frames[currentFrame].overlayGlyphCount > 0) {
+            jobCount++;
+        }
 
-        VkPipelineRasterizationStateCreateInfo rasterizer{};
-        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizer.depthClampEnable = VK_FALSE;
-        rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizer.lineWidth = 1.0f;
-        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-        rasterizer.depthBiasEnable = VK_FALSE;
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = renderPass;
+        inheritanceInfo.subpass = 0;
+
+        VkCommandBufferInheritanceRenderingInfoKHR inheritanceRenderingInfo{};
+        if (dynamicRenderingEnabled) {
+            inheritanceRenderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO_KHR;
+            inheritanceRenderingInfo.colorAttachmentCount = 1;
+            inheritanceRenderingInfo.pColorAttachmentFormats = &swapChainImageFormat;
+            inheritanceRenderingInfo.depthAttachmentFormat = depthFormat;
+            inheritanceRenderingInfo.rasterizationSamples = msaaSamples;
+            inheritanceInfo.pNext = &inheritanceRenderingInfo;
+        } else {
+            inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];
+        }
 
-        VkPipelineMultisampleStateCreateInfo multisampling{};
-        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        std::vector<VkCommandBuffer> secondaries(jobCount);
+        jobs.parallelFor(jobCount, [&](uint32_t job, uint32_t workerIndex) {
+            TRACE_SCOPE("record secondary");
 
-        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachment.blendEnable = VK_FALSE;
+            VkCommandBuffer secondary = acquireSecondary(frames[currentFrame].workerPools[workerIndex]);
 
-        VkPipelineColorBlendStateCreateInfo colorBlending{};
-        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        colorBlending.logicOpEnable = VK_FALSE;
-        colorBlending.logicOp = VK_LOGIC_OP_COPY;
-        colorBlending.attachmentCount = 1;
-        colorBlending.pAttachments = &colorBlendAttachment;
-        colorBlending.blendConstants[0] = 0.0f;
-        colorBlending.blendConstants[1] = 0.0f;
-        colorBlending.blendConstants[2] = 0.0f;
-        colorBlending.blendConstants[3] = 0.0f;
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            beginInfo.pInheritanceInfo = &inheritanceInfo;
 
-        std::vector<VkDynamicState> dynamicStates = {
-            VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_SCISSOR
+            if (vkBeginCommandBuffer(secondary, &beginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("failed to begin recording command buffer!");
+            }
+
+            recordViewportAndScissor(secondary);
+            if (job == overlayJob) {
+                recordOverlay(secondary);
+            } else {
+                recordSlice(secondary, job);
+            }
+
+            if (vkEndCommandBuffer(secondary) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record command buffer!");
+            }
+            secondaries[job] = secondary;
+        });
+
+        if (!secondaries.empty()) {
+            vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+        }
+
+        if (dynamicRenderingEnabled) {
+            endDynamicRendering(commandBuffer, imageIndex);
+        } else {
+            vkCmdEndRenderPass(commandBuffer);
+        }
+    }
+
+    // Blits the renderExtent corner of sceneColorImage over the whole swapchain image with linear filtering,
+    // and leaves the image ready to present or read back.
+    void recordUpscale(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = swapChainImages[imageIndex];
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.layerCount = 1;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkImageBlit blit{};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.layerCount = 1;
+        blit.srcOffsets[1] = {static_cast<int32_t>(renderExtent.width), static_cast<int32_t>(renderExtent.height), 1};
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.layerCount = 1;
+        blit.dstOffsets[1] = {static_cast<int32_t>(swapChainExtent.width), static_cast<int32_t>(swapChainExtent.height), 1};
+        vkCmdBlitImage(commandBuffer, sceneColorImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swapChainImages[imageIndex],
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = config.headless ? VK_ACCESS_TRANSFER_READ_BIT : 0;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        VkPipelineStageFlags dstStage = config.headless ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    VkImageAspectFlags depthAspectMask() const {
+        return depthFormat == VK_FORMAT_D32_SFLOAT ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+
+    // What the render pass's attachment layouts and subpass dependencies do, as barriers: the previous
+    // frame's depth writes and pyramid build finish before the shared depth buffer is cleared again.
+    void beginDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, const std::array<VkClearValue, 2>& clearValues) {
+        std::vector<SceneAttachment> targets = sceneAttachments(imageIndex);
+
+        std::vector<VkImageMemoryBarrier> barriers;
+        for (const SceneAttachment& target : targets) {
+            bool depth = (target.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) != 0;
+
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = depth ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : 0;
+            barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                (depth ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : 0);
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = target.layout;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = target.image;
+            barrier.subresourceRange.aspectMask = target.aspect;
+            barrier.subresourceRange.levelCount = 1;
+            barrier.subresourceRange.layerCount = 1;
+            barriers.push_back(barrier);
+        }
+
+        VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        if (dynamicResolutionEnabled) {
+            srcStages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+        }
+        vkCmdPipelineBarrier(commandBuffer, srcStages,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+        auto attachmentInfo = [&](SceneAttachmentIndex index, const VkClearValue& clearValue) {
+            VkRenderingAttachmentInfoKHR attachment{};
+            attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+            attachment.imageView = targets[index].view;
+            attachment.imageLayout = targets[index].layout;
+            attachment.loadOp = targets[index].loadOp;
+            attachment.storeOp = targets[index].storeOp;
+            attachment.clearValue = clearValue;
+            return attachment;
         };
-        VkPipelineDynamicStateCreateInfo dynamicState{};
-        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-        dynamicState.pDynamicStates = dynamicStates.data();
 
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 0;
-        pipelineLayoutInfo.pushConstantRangeCount = 0;
+        VkRenderingAttachmentInfoKHR colorAttachment = attachmentInfo(SCENE_COLOR, clearValues[0]);
+        VkRenderingAttachmentInfoKHR depthAttachment = attachmentInfo(SCENE_DEPTH, clearValues[1]);
+
+        // as in the render pass, the pyramid is built from sample 0 of the resolved depth
+        if (targets.size() > SCENE_COLOR_RESOLVE) {
+            colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+            colorAttachment.resolveImageView = targets[SCENE_COLOR_RESOLVE].view;
+            colorAttachment.resolveImageLayout = targets[SCENE_COLOR_RESOLVE].layout;
+
+            depthAttachment.resolveMode = VK_RESOLVE_MODE_SAMPLE_ZERO_BIT;
+            depthAttachment.resolveImageView = targets[SCENE_DEPTH_RESOLVE].view;
+            depthAttachment.resolveImageLayout = targets[SCENE_DEPTH_RESOLVE].layout;
+        }
+
+        VkRenderingInfoKHR renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+        renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT_KHR;
+        renderingInfo.renderArea.offset = {0, 0};
+        renderingInfo.renderArea.extent = renderExtent;
+        renderingInfo.layerCount = 1;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachments = &colorAttachment;
+        renderingInfo.pDepthAttachment = &depthAttachment;
+
+        pfnCmdBeginRendering(commandBuffer, &renderingInfo);
+    }
+
+    // leaves color ready to present (or for the readback copy) and depth readable by the pyramid build;
+    // transient attachments stay as they are
+    void endDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        pfnCmdEndRendering(commandBuffer);
+
+        std::vector<VkImageMemoryBarrier> barriers;
+        for (const SceneAttachment& target : sceneAttachments(imageIndex)) {
+            if (target.finalLayout == target.layout) {
+                continue;
+            }
+
+            bool depth = (target.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) != 0;
+
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | (depth ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : 0);
+            if (depth) {
+                barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            } else {
+                barrier.dstAccessMask = sceneColorReadByTransfer() ? VK_ACCESS_TRANSFER_READ_BIT : 0;
+            }
+            barrier.oldLayout = target.layout;
+            barrier.newLayout = target.finalLayout;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = target.image;
+            barrier.subresourceRange.aspectMask = target.aspect;
+            barrier.subresourceRange.levelCount = 1;
+            barrier.subresourceRange.layerCount = 1;
+            barriers.push_back(barrier);
+        }
+
+        VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dstStages |= sceneColorReadByTransfer() ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, dstStages,
+            0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+    }
+
+    // secondaries inherit none of the primary's dynamic state
+    void recordViewportAndScissor(VkCommandBuffer commandBuffer) {
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float) renderExtent.width;
+        viewport.height = (float) renderExtent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.offset = {0, 0};
+        scissor.extent = renderExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    }
+
+    // the frame's instance data, and the bindless set everything else is reached through
+    void bindSceneDescriptorSets(VkCommandBuffer commandBuffer, const FrameContext& frame) {
+        std::array<VkDescriptorSet, 2> sets = {frame.descriptorSet, bindless.set()};
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+    }
+
+    PushConstants scenePushConstants(const FrameContext& frame) const {
+        PushConstants pushConstants{};
+        pushConstants.instanceStride = frame.instanceCapacity;
+        pushConstants.materialTable = materialTable;
+        pushConstants.materialCount = static_cast<uint32_t>(materials.size());
+        return pushConstants;
+    }
+
+    // Until a pipeline finishes compiling its objects are skipped, which keeps the window responsive. Each
+    // draw group is one indirect call however many objects it holds, with the commands and counts that
+    // recordCulling() wrote.
+    void recordDrawGroups(VkCommandBuffer commandBuffer, uint32_t firstGroup, uint32_t endGroup) {
+        const FrameContext& frame = frames[currentFrame];
+
+        bindSceneDescriptorSets(commandBuffer, frame);
+
+        PushConstants pushConstants = scenePushConstants(frame);
+        pushConstants.visibleInstances = 1;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+        VkDeviceSize commandsOffset = indirectCommandsOffset(frame.indirectCapacity);
+        uint64_t drawCalls = 0;
+        for (uint32_t group = firstGroup; group < endGroup; group++) {
+            const DrawGroup& drawGroup = drawGroups[group];
+            VkPipeline pipeline = pipelineLibrary->get(drawGroup.pipeline);
+            if (pipeline == VK_NULL_HANDLE) {
+                continue;
+            }
+            drawCalls++;
+
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+            const MeshRange& mesh = batcher.mesh(drawGroup.mesh);
+            VkBuffer vertexBuffers[] = {mesh.vertexBuffer};
+            VkDeviceSize offsets[] = {0};
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+            vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer, 0, mesh.indexType);
+
+            VkDeviceSize offset = commandsOffset + static_cast<VkDeviceSize>(drawGroup.firstCommand) * sizeof(VkDrawIndexedIndirectCommand);
+            if (drawIndirectCountEnabled) {
+                vkCmdDrawIndexedIndirectCount(commandBuffer, frame.indirectBuffer, offset, frame.indirectBuffer, group * sizeof(uint32_t),
+                    drawGroup.commandCount, sizeof(VkDrawIndexedIndirectCommand));
+            } else {
+                vkCmdDrawIndexedIndirect(commandBuffer, frame.indirectBuffer, offset, drawGroup.commandCount, sizeof(VkDrawIndexedIndirectCommand));
+            }
+        }
+        Telemetry::instance().add(Telemetry::DrawCalls, drawCalls);
+    }
+
+    // one vkCmdDrawIndexed per object, so the benchmark can show what batching saves
+    void recordDirectDraws(VkCommandBuffer commandBuffer, uint32_t firstObject, uint32_t endObject) {
+        const FrameContext& frame = frames[currentFrame];
+        VkPipeline pipeline = pipelineLibrary->get(graphicsPipeline);
+        if (pipeline == VK_NULL_HANDLE) {
+            return;
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        bindSceneDescriptorSets(commandBuffer, frame);
+
+        PushConstants pushConstants = scenePushConstants(frame);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+        VkBuffer vertexBuffers[] = {vertexBuffer};
+        VkDeviceSize offsets[] = {0};
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+
+        for (uint32_t i = firstObject; i < endObject; i++) {
+            vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, i);
+        }
+        Telemetry::instance().add(Telemetry::DrawCalls, endObject - firstObject);
+    }
+
+    // draws whatever part of the mesh has streamed in; the upload flush before submit covers all of it
+    void recordMeshDraw(VkCommandBuffer commandBuffer) {
+        VkPipeline pipeline = pipelineLibrary->get(meshPipeline);
+        uint32_t indexCount = meshStreamer.drawableIndexCount();
+        if (pipeline == VK_NULL_HANDLE || indexCount == 0) {
+            return;
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(meshPushConstants), &meshPushConstants);
+
+        VkBuffer vertexBuffers[] = {meshVertexBuffer};
+        VkDeviceSize offsets[] = {0};
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+        vkCmdBindIndexBuffer(commandBuffer, meshIndexBuffer, 0, meshStreamer.indexType());
+
+        vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+        Telemetry::instance().add(Telemetry::DrawCalls);
+    }
+
+    // Six vertices per character, laid out from the top left corner. Sized against the swapchain rather than
+    // the render extent, so dynamic resolution does not change how big the text comes out on screen.
+    void recordOverlay(VkCommandBuffer commandBuffer) {
+        const FrameContext& frame = frames[currentFrame];
+        VkPipeline pipeline = pipelineLibrary->get(overlayPipeline);
+        if (pipeline == VK_NULL_HANDLE || frame.overlayGlyphCount == 0) {
+            return;
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        bindSceneDescriptorSets(commandBuffer, frame);
+
+        OverlayPushConstants pushConstants{};
+        pushConstants.glyphBuffer = frame.overlayBinding;
+        pushConstants.glyphCount = frame.overlayGlyphCount;
+        pushConstants.cellSize[0] = 2.0f * 6 * OVERLAY_PIXEL_SIZE / swapChainExtent.width;
+        pushConstants.cellSize[1] = 2.0f * 9 * OVERLAY_PIXEL_SIZE / swapChainExtent.height;
+        pushConstants.origin[0] = -1.0f + pushConstants.cellSize[0];
+        pushConstants.origin[1] = -1.0f + pushConstants.cellSize[1];
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+        vkCmdDraw(commandBuffer, frame.overlayGlyphCount * 6, 1, 0, 0);
+        Telemetry::instance().add(Telemetry::DrawCalls);
+    }
+
+    void recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {swapChainExtent.width, swapChainExtent.height, 1};
+
+        VkBuffer readbackBuffer = frames[currentFrame].readbackBuffer;
+        vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &region);
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = readbackBuffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+
+    // one persistently mapped buffer per frame in flight, so reading frame N back never stalls the GPU on frame N+1
+    void createReadbackBuffers() {
+        if (!config.headless) {
+            return;
+        }
+
+        if (!config.dumpFramesDirectory.empty()) {
+            std::filesystem::create_directories(config.dumpFramesDirectory);
+        }
+
+        VkDeviceSize size = static_cast<VkDeviceSize>(swapChainExtent.width) * swapChainExtent.height * 4;
+
+        for (auto& frame : frames) {
+            // cached memory makes the CPU-side reads much faster where it exists
+            createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                VK_MEMORY_PROPERTY_HOST_CACHED_BIT, frame.readbackBuffer, frame.readbackMemory);
+        }
+    }
+
+    // small enough to create up front for every frame, so F3 never has to allocate
+    void createOverlayBuffers() {
+        for (auto& frame : frames) {
+            createBuffer(OVERLAY_MAX_GLYPHS * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                frame.overlayBuffer, frame.overlayMemory);
+            frame.overlayBinding = bindless.addBuffer(frame.overlayBuffer);
+        }
+    }
+
+    // hands a finished headless frame to the consumer; only called once the frame has retired
+    void deliverReadback(const FrameContext& frame) {
+        if (config.dumpFramesDirectory.empty()) {
+            return;
+        }
+
+        char fileName[32];
+        snprintf(fileName, sizeof(fileName), "frame_%06llu.ppm", static_cast<unsigned long long>(frame.serial));
+        std::ofstream file(std::filesystem::path(config.dumpFramesDirectory) / fileName, std::ios::binary);
+        file << "P6\n" << swapChainExtent.width << " " << swapChainExtent.height << "\n255\n";
+
+        const uint8_t* pixels = static_cast<const uint8_t*>(frame.readbackMemory.data);
+        std::vector<char> row(swapChainExtent.width * 3);
+        for (uint32_t y = 0; y < swapChainExtent.height; y++) {
+            for (uint32_t x = 0; x < swapChainExtent.width; x++) {
+                const uint8_t* pixel = pixels + (static_cast<size_t>(y) * swapChainExtent.width + x) * 4;
+                row[x * 3 + 0] = static_cast<char>(pixel[0]);
+                row[x * 3 + 1] = static_cast<char>(pixel[1]);
+                row[x * 3 + 2] = static_cast<char>(pixel[2]);
+            }
+            file.write(row.data(), row.size());
+        }
+    }
+
+    // the graphics timeline tracks every frame; the binary semaphores are only for acquire and present,
+    // which cannot take a timeline
+    void createSyncObjects() {
+        graphicsTimeline.create(device, "graphics");
+        if (asyncComputeEnabled) {
+            computeTimeline.create(device, "compute");
+        }
+
+        if (config.headless) {
+            return;
+        }
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        for (auto& frame : frames) {
+            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &frame.imageAvailableSemaphore) != VK_SUCCESS ||
+                vkCreateSemaphore(device, &semaphoreInfo, nullptr, &frame.renderFinishedSemaphore) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create synchronization objects for a frame!");
+            }
+        }
+    }
+
+    // waits until the current slot is free again and runs everything that was waiting on it
+    FrameContext& beginFrame() {
+        FrameContext& frame = frames[currentFrame];
+
+        {
+            TRACE_SCOPE("wait for frame");
+            graphicsTimeline.wait(frame.serial);
+        }
+        // later frames may have finished too, which lets the deletion queue run ahead
+        completedSerial = graphicsTimeline.completedValue();
+        deletionQueue.flush(completedSerial);
+
+        if (gpuProfiler) {
+            bool sampled = gpuProfiler->collect(currentFrame);
+            if (sampled && dynamicResolutionEnabled) {
+                updateResolutionScale(frame);
+            }
+        }
+        frame.resolutionScale = resolutionScale;
+        renderExtent = scaledExtent(resolutionScale);
+
+        {
+            TRACE_SCOPE("update telemetry");
+            updateTelemetry();
+        }
+
+        {
+            TRACE_SCOPE("update pipelines");
+            updatePipelines();
+        }
+
+        {
+            TRACE_SCOPE("update instances");
+            uploadInstances(frame);
+            uploadOverlay(frame);
+        }
+
+        return frame;
+    }
 
-        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create pipeline layout!");
+    // GPU time goes with the pixel count, so the side length wanted goes with the square root of how far
+    // the scene pass is off its share of the frame time. The sample is a few frames old and was measured at
+    // the scale that frame rendered with, so each one only moves the scale part of the way.
+    void updateResolutionScale(const FrameContext& frame) {
+        std::optional<double> sceneMs = gpuProfiler->latest("render pass");
+        if (!sceneMs || sceneMs.value() <= 0.0) {
+            return;
         }
 
-        VkGraphicsPipelineCreateInfo pipelineInfo{};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2;
-        pipelineInfo.pStages = shaderStages;
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
-        pipelineInfo.pViewportState = &viewportState;
-        pipelineInfo.pRasterizationState = &rasterizer;
-        pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pColorBlendState = &colorBlending;
-        pipelineInfo.pDynamicState = &dynamicState;
-        pipelineInfo.layout = pipelineLayout;
-        pipelineInfo.renderPass = renderPass;
-        pipelineInfo.subpass = 0;
-        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        double budgetMs = 1000.0 / config.targetFps * RESOLUTION_HEADROOM;
+        double wanted = frame.resolutionScale * std::sqrt(budgetMs / sceneMs.value());
+        resolutionScale = std::clamp(resolutionScale + (wanted - resolutionScale) * RESOLUTION_DAMPING, MIN_RESOLUTION_SCALE, 1.0);
+    }
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create graphics pipeline!");
+    VkExtent2D scaledExtent(double scale) const {
+        return {
+            std::max(1u, static_cast<uint32_t>(std::lround(swapChainExtent.width * scale))),
+            std::max(1u, static_cast<uint32_t>(std::lround(swapChainExtent.height * scale)))
+        };
+    }
+
+    // Every frame: the frame time gauges and the hitch count. Every TELEMETRY_INTERVAL_S: the memory heaps,
+    // the overlay text and the --stats file, with rates taken over the interval.
+    void updateTelemetry() {
+        Telemetry& telemetry = Telemetry::instance();
+        auto now = std::chrono::steady_clock::now();
+
+        if (lastFrameStart) {
+            double frameMs = std::chrono::duration<double, std::milli>(now - lastFrameStart.value()).count();
+            telemetry.set(Telemetry::FrameTimeMs, frameMs);
+            if (averageFrameMs > 0.0 && frameMs > averageFrameMs * HITCH_FACTOR) {
+                telemetry.add(Telemetry::Hitches);
+            }
+            // slow to move, so one hitch hardly raises the bar for the next
+            averageFrameMs = averageFrameMs == 0.0 ? frameMs : averageFrameMs + (frameMs - averageFrameMs) * 0.05;
+        }
+        lastFrameStart = now;
+
+        telemetry.add(Telemetry::Frames);
+        telemetry.set(Telemetry::CpuSubmitMs, lastSubmitCpuMs);
+        telemetry.set(Telemetry::ResolutionScale, resolutionScale);
+        if (gpuProfiler) {
+            if (std::optional<double> sceneMs = gpuProfiler->latest("render pass")) {
+                telemetry.set(Telemetry::GpuSceneMs, sceneMs.value());
+            }
+        }
+
+        if (now - lastTelemetry.time < std::chrono::duration<double>(TELEMETRY_INTERVAL_S)) {
+            return;
         }
 
-        vkDestroyShaderModule(device, fragShaderModule, nullptr);
-        vkDestroyShaderModule(device, vertShaderModule, nullptr);
+        updateMemoryTelemetry();
+        Telemetry::Snapshot snapshot = telemetry.snapshot();
+        buildOverlayText(snapshot, lastTelemetry);
+        if (!config.statsPath.empty()) {
+            writeStats(snapshot, lastTelemetry);
+        }
+        lastTelemetry = std::move(snapshot);
     }
 
-    void createFramebuffers() {
-        swapChainFramebuffers.resize(swapChainImageViews.size());
+    // VK_EXT_memory_budget reports the whole process's usage of each heap against what the driver will let
+    // it have; without it the allocator's reservations stand in, against the heap sizes
+    void updateMemoryTelemetry() {
+        const VkPhysicalDeviceMemoryProperties& memoryProperties = capabilities(physicalDevice).memoryProperties;
 
-        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            VkImageView attachments[] = {
-                swapChainImageViews[i]
-            };
+        std::vector<Telemetry::HeapUsage> heaps(memoryProperties.memoryHeapCount);
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+            heaps[i].budget = memoryProperties.memoryHeaps[i].size;
+            heaps[i].deviceLocal = (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        }
 
-            VkFramebufferCreateInfo framebufferInfo{};
-            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferInfo.renderPass = renderPass;
-            framebufferInfo.attachmentCount = 1;
-            framebufferInfo.pAttachments = attachments;
-            framebufferInfo.width = swapChainExtent.width;
-            framebufferInfo.height = swapChainExtent.height;
-            framebufferInfo.layers = 1;
+        if (memoryBudgetEnabled) {
+            VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+            budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
 
-            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
-                throw std::runtime_error("failed to create framebuffer!");
+            VkPhysicalDeviceMemoryProperties2 properties{};
+            properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+            properties.pNext = &budget;
+            vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+            for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+                heaps[i].usage = budget.heapUsage[i];
+                heaps[i].budget = budget.heapBudget[i];
+            }
+        } else {
+            std::vector<DeviceAllocator::MemoryTypeStats> stats = allocator->stats();
+            for (uint32_t type = 0; type < stats.size(); type++) {
+                heaps[memoryProperties.memoryTypes[type].heapIndex].usage += stats[type].reservedBytes;
             }
         }
+
+        Telemetry::instance().setHeaps(heaps);
     }
 
-    void createCommandPool() {
-        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+    void buildOverlayText(const Telemetry::Snapshot& snapshot, const Telemetry::Snapshot& previous) {
+        const double MIB = 1024.0 * 1024.0;
 
-        VkCommandPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+        double seconds = std::chrono::duration<double>(snapshot.time - previous.time).count();
+        auto delta = [&](Telemetry::Counter counter) {
+            return static_cast<double>(snapshot.counters[counter] - previous.counters[counter]);
+        };
+        double frames = std::max(delta(Telemetry::Frames), 1.0);
+
+        std::vector<std::string> lines;
+        char line[128];
+        snprintf(line, sizeof(line), "frame %.2f ms (%.0f fps)  cpu submit %.2f ms", snapshot.gauges[Telemetry::FrameTimeMs],
+            delta(Telemetry::Frames) / seconds, snapshot.gauges[Telemetry::CpuSubmitMs]);
+        lines.push_back(line);
+        if (gpuProfiler) {
+            snprintf(line, sizeof(line), "gpu scene %.2f ms  resolution %.0f%%", snapshot.gauges[Telemetry::GpuSceneMs],
+                snapshot.gauges[Telemetry::ResolutionScale] * 100.0);
+            lines.push_back(line);
+        }
+        snprintf(line, sizeof(line), "draws/frame %.0f  uploads %.2f mb/s", delta(Telemetry::DrawCalls) / frames,
+            delta(Telemetry::BytesUploaded) / seconds / MIB);
+        lines.push_back(line);
+        snprintf(line, sizeof(line), "pipelines compiled %llu  swapchain recreations %llu  hitches %llu",
+            static_cast<unsigned long long>(snapshot.counters[Telemetry::PipelinesCompiled]),
+            static_cast<unsigned long long>(snapshot.counters[Telemetry::SwapchainRecreations]),
+            static_cast<unsigned long long>(snapshot.counters[Telemetry::Hitches]));
+        lines.push_back(line);
+        for (uint32_t i = 0; i < snapshot.heaps.size(); i++) {
+            const Telemetry::HeapUsage& heap = snapshot.heaps[i];
+            snprintf(line, sizeof(line), "heap %u %s %.0f / %.0f mb (%.0f%%)", i, heap.deviceLocal ? "device" : "host",
+                heap.usage / MIB, heap.budget / MIB, heap.budget > 0 ? 100.0 * heap.usage / heap.budget : 0.0);
+            lines.push_back(line);
+        }
 
-        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create command pool!");
+        // the font only has ASCII 32-95, so the text is upper-cased and anything else becomes '?'
+        overlayGlyphs.clear();
+        for (uint32_t row = 0; row < lines.size(); row++) {
+            for (uint32_t column = 0; column < lines[row].size() && column < 256; column++) {
+                int character = std::toupper(static_cast<unsigned char>(lines[row][column]));
+                if (character < 32 || character > 95) {
+                    character = '?';
+                }
+                if (overlayGlyphs.size() < OVERLAY_MAX_GLYPHS) {
+                    overlayGlyphs.push_back(column | row << 8 | static_cast<uint32_t>(character - 32) << 16);
+                }
+            }
         }
+        overlayVersion++;
     }
 
-    void createCommandBuffers() {
-        commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    // the snapshot as JSON; written beside the file and renamed over it, so a reader never sees half of one
+    void writeStats(const Telemetry::Snapshot& snapshot, const Telemetry::Snapshot& previous) {
+        double seconds = std::chrono::duration<double>(snapshot.time - previous.time).count();
+        std::string temporaryPath = config.statsPath + ".tmp";
+
+        bool written;
+        {
+            std::ofstream file(temporaryPath);
+            file << "{\"uptime_s\":" << std::chrono::duration<double>(snapshot.time - telemetryStart).count()
+                << ",\"interval_s\":" << seconds << ",\"counters\":{";
+            for (uint32_t i = 0; i < Telemetry::COUNTER_COUNT; i++) {
+                file << (i > 0 ? "," : "") << "\"" << Telemetry::name(static_cast<Telemetry::Counter>(i)) << "\":" << snapshot.counters[i];
+            }
+            file << "},\"rates_per_s\":{";
+            for (uint32_t i = 0; i < Telemetry::COUNTER_COUNT; i++) {
+                file << (i > 0 ? "," : "") << "\"" << Telemetry::name(static_cast<Telemetry::Counter>(i)) << "\":"
+                    << (snapshot.counters[i] - previous.counters[i]) / seconds;
+            }
+            file << "},\"gauges\":{";
+            for (uint32_t i = 0; i < Telemetry::GAUGE_COUNT; i++) {
+                file << (i > 0 ? "," : "") << "\"" << Telemetry::name(static_cast<Telemetry::Gauge>(i)) << "\":" << snapshot.gauges[i];
+            }
+            file << "},\"memory_budget_ext\":" << (memoryBudgetEnabled ? "true" : "false") << ",\"heaps\":[";
+            for (uint32_t i = 0; i < snapshot.heaps.size(); i++) {
+                const Telemetry::HeapUsage& heap = snapshot.heaps[i];
+                file << (i > 0 ? "," : "") << "{\"device_local\":" << (heap.deviceLocal ? "true" : "false") << ",\"usage_bytes\":"
+                    << heap.usage << ",\"budget_bytes\":" << heap.budget << "}";
+            }
+            file << "]}\n";
+            written = static_cast<bool>(file);
+        }
 
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = commandPool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = (uint32_t) commandBuffers.size();
+        std::error_code error;
+        if (written) {
+            std::filesystem::rename(temporaryPath, config.statsPath, error);
+        }
+        if ((!written || error) && !statsWriteFailed) {
+            statsWriteFailed = true;
+            std::cerr << "failed to write stats to " << config.statsPath << "!" << std::endl;
+        }
+    }
 
-        if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate command buffers!");
+    void uploadOverlay(FrameContext& frame) {
+        if (frame.overlayVersion == overlayVersion) {
+            return;
         }
+        frame.overlayVersion = overlayVersion;
+
+        std::memcpy(frame.overlayMemory.data, overlayGlyphs.data(), overlayGlyphs.size() * sizeof(uint32_t));
+        frame.overlayGlyphCount = static_cast<uint32_t>(overlayGlyphs.size());
     }
 
-    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    // The next frame's simulation runs alongside this frame's recording: the frame's instance buffers
+    // already hold its copy of the scene, so recording never reads what the simulation writes.
+    void recordFrame(FrameContext& frame, uint32_t imageIndex) {
+        updateFrameDepthPyramid(frame);
+
+        TaskGraph graph;
+        graph.add("simulate", [this] { updateScene(); });
+        graph.add("record command buffer", [this, &frame, imageIndex] {
+            resetCommandPools(frame);
+            frame.computeRecorded = asyncComputeEnabled && cullingActive();
+            if (frame.computeRecorded) {
+                recordComputeCommandBuffer(frame.computeCommandBuffer);
+            }
+            recordCommandBuffer(frame.commandBuffer, imageIndex);
+        });
+        jobs.run(graph);
+    }
 
-        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-            throw std::runtime_error("failed to begin recording command buffer!");
+    struct SemaphoreWaits {
+        std::vector<VkSemaphore> semaphores;
+        std::vector<uint64_t> values;
+        std::vector<VkPipelineStageFlags> stages;
+
+        void add(VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags stage) {
+            semaphores.push_back(semaphore);
+            values.push_back(value);
+            stages.push_back(stage);
         }
 
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = swapChainExtent;
+        uint32_t count() const {
+            return static_cast<uint32_t>(semaphores.size());
+        }
+    };
+
+    // Vertex input must not start before the uploads the frame reads from have landed, and with async
+    // compute no indirect draw before the frame's culling, which is submitted here.
+    void addFrameWaits(const FrameContext& frame, uint64_t frameSerial, SemaphoreWaits& waits) {
+        waits.add(uploads.semaphore(), uploads.flush(), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 
-        VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-        renderPassInfo.clearValueCount = 1;
-        renderPassInfo.pClearValues = &clearColor;
+        if (frame.computeRecorded) {
+            submitCompute(frame, frameSerial);
+            waits.add(computeTimeline.semaphore(), frameSerial, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+        }
+    }
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    // The pyramid is built from the depth buffer the previous frame left behind, so the compute submit
+    // waits for that frame's graphics submit and no more. It signals the frame's serial on the compute
+    // timeline; the frame's graphics submit waits for that before its first indirect draw.
+    void submitCompute(const FrameContext& frame, uint64_t frameSerial) {
+        uint64_t previousSerial = frameSerial - 1;
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = 1;
+        timelineInfo.pWaitSemaphoreValues = &previousSerial;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &frameSerial;
+
+        VkSemaphore waitSemaphore = graphicsTimeline.semaphore();
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        VkSemaphore signalSemaphore = computeTimeline.semaphore();
 
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &waitSemaphore;
+        submitInfo.pWaitDstStageMask = &waitStage;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &frame.computeCommandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &signalSemaphore;
 
-            VkViewport viewport{};
-            viewport.x = 0.0f;
-            viewport.y = 0.0f;
-            viewport.width = (float) swapChainExtent.width;
-            viewport.height = (float) swapChainExtent.height;
-            viewport.minDepth = 0.0f;
-            viewport.maxDepth = 1.0f;
-            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        TRACE_SCOPE("submit compute");
+        std::lock_guard<std::mutex> lock(queueMutex(computeQueue));
+        if (vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit compute command buffer!");
+        }
+    }
 
-            VkRect2D scissor{};
-            scissor.offset = {0, 0};
-            scissor.extent = swapChainExtent;
-            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    void drawOffscreenFrame() {
+        FrameContext& frame = beginFrame();
 
-            vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+        if (frame.serial > 0) {
+            TRACE_SCOPE("deliver readback");
+            deliverReadback(frame);
+        }
 
-        vkCmdEndRenderPass(commandBuffer);
+        logFrame();
 
-        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-            throw std::runtime_error("failed to record command buffer!");
+        auto submitStart = std::chrono::steady_clock::now();
+        {
+            TRACE_SCOPE("record");
+            recordFrame(frame, currentFrame);
         }
-    }
 
-    void createSyncObjects() {
-        imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+        uint64_t frameSerial = submittedSerial + 1;
+        SemaphoreWaits waits;
+        addFrameWaits(frame, frameSerial, waits);
 
-        VkSemaphoreCreateInfo semaphoreInfo{};
-        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = waits.count();
+        timelineInfo.pWaitSemaphoreValues = waits.values.data();
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &frameSerial;
 
-        VkFenceCreateInfo fenceInfo{};
-        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        VkSemaphore signalSemaphores[] = {graphicsTimeline.semaphore()};
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-                vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
-                throw std::runtime_error("failed to create synchronization objects for a frame!");
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.waitSemaphoreCount = waits.count();
+        submitInfo.pWaitSemaphores = waits.semaphores.data();
+        submitInfo.pWaitDstStageMask = waits.stages.data();
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &frame.commandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = signalSemaphores;
+
+        {
+            TRACE_SCOPE("submit");
+            std::lock_guard<std::mutex> lock(queueMutex(graphicsQueue));
+            if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit draw command buffer!");
             }
         }
+        submittedSerial = frameSerial;
+        frame.serial = frameSerial;
+        lastSubmitCpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitStart).count();
+        reportStartup();
+
+        currentFrame = (currentFrame + 1) % static_cast<uint32_t>(frames.size());
+    }
+
+    // the scene beginFrame() uploaded, before recordFrame() simulates the next one; called only once the frame
+    // is sure to be drawn, so a frame given up on an out-of-date swapchain is not logged
+    void logFrame() {
+        if (frameLogWriter.isOpen()) {
+            TRACE_SCOPE("log frame");
+            frameLogWriter.write(batcher, directDraws);
+        }
+    }
+
+    // once, when the first frame has been handed to the GPU
+    void reportStartup() {
+        if (startupReported) {
+            return;
+        }
+        startupReported = true;
+
+        startup.phase("first frame");
+        startup.report(STARTUP_BUDGET_MS);
     }
 
     void drawFrame() {
-        vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        FrameContext& frame = beginFrame();
 
         uint32_t imageIndex;
-        VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+        VkResult result;
+        {
+            TRACE_SCOPE("acquire");
+            result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, frame.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+        }
 
         if (result == VK_ERROR_OUT_OF_DATE_KHR) {
             recreateSwapChain();
@@ -697,36 +7091,61 @@ private:
             throw std::runtime_error("failed to acquire swap chain image!");
         }
 
-        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+        logFrame();
+
+        auto submitStart = std::chrono::steady_clock::now();
+        {
+            TRACE_SCOPE("record");
+            recordFrame(frame, imageIndex);
+        }
 
-        vkResetCommandBuffer(commandBuffers[currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
-        recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+        // binary semaphores ignore their values; the graphics timeline marks the frame done
+        uint64_t frameSerial = submittedSerial + 1;
+        SemaphoreWaits waits;
+        // with dynamic resolution the upscale blit is the first to touch the swapchain image
+        VkPipelineStageFlags imageWaitStage = dynamicResolutionEnabled ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        waits.add(frame.imageAvailableSemaphore, 0, imageWaitStage);
+        addFrameWaits(frame, frameSerial, waits);
+
+        uint64_t signalValues[] = {0, frameSerial};
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = waits.count();
+        timelineInfo.pWaitSemaphoreValues = waits.values.data();
+        timelineInfo.signalSemaphoreValueCount = 2;
+        timelineInfo.pSignalSemaphoreValues = signalValues;
 
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
 
-        VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = waitSemaphores;
-        submitInfo.pWaitDstStageMask = waitStages;
+        submitInfo.waitSemaphoreCount = waits.count();
+        submitInfo.pWaitSemaphores = waits.semaphores.data();
+        submitInfo.pWaitDstStageMask = waits.stages.data();
 
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+        submitInfo.pCommandBuffers = &frame.commandBuffer;
 
-        VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-        submitInfo.signalSemaphoreCount = 1;
+        VkSemaphore signalSemaphores[] = {frame.renderFinishedSemaphore, graphicsTimeline.semaphore()};
+        submitInfo.signalSemaphoreCount = 2;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
-        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to submit draw command buffer!");
+        {
+            TRACE_SCOPE("submit");
+            std::lock_guard<std::mutex> lock(queueMutex(graphicsQueue));
+            if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit draw command buffer!");
+            }
         }
+        submittedSerial = frameSerial;
+        frame.serial = frameSerial;
+        lastSubmitCpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitStart).count();
 
         VkPresentInfoKHR presentInfo{};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
         presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = signalSemaphores;
+        presentInfo.pWaitSemaphores = &frame.renderFinishedSemaphore;
 
         VkSwapchainKHR swapChains[] = {swapChain};
         presentInfo.swapchainCount = 1;
@@ -734,30 +7153,126 @@ private:
 
         presentInfo.pImageIndices = &imageIndex;
 
-        result = vkQueuePresentKHR(presentQueue, &presentInfo);
+        uint64_t presentId = frame.serial;
+        VkPresentIdKHR presentIdInfo{};
+        presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+        presentIdInfo.swapchainCount = 1;
+        presentIdInfo.pPresentIds = &presentId;
+        if (presentWaitEnabled) {
+            presentInfo.pNext = &presentIdInfo;
+        }
+
+        {
+            TRACE_SCOPE("present");
+            std::lock_guard<std::mutex> lock(queueMutex(presentQueue));
+            result = vkQueuePresentKHR(presentQueue, &presentInfo);
+        }
+        reportStartup();
+
+        if (presentWaitEnabled && (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)) {
+            lastPresentId = presentId;
+            presentInputTimes.emplace_back(presentId, inputSampleTime);
+        }
 
-        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
-            framebufferResized = false;
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || resizePending) {
+            resizePending = false;
             recreateSwapChain();
         } else if (result != VK_SUCCESS) {
             throw std::runtime_error("failed to present swap chain image!");
         }
 
-        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        currentFrame = (currentFrame + 1) % static_cast<uint32_t>(frames.size());
     }
 
-    VkShaderModule createShaderModule(const std::vector<char>& code) {
-        VkShaderModuleCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+    // with more than one queue family the buffer is shared CONCURRENT, which saves ownership transfer barriers
+    // for buffers that are written once and then only read
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferredProperties, VkBuffer& buffer, MemoryAllocation& bufferMemory,
+        const std::vector<uint32_t>& queueFamilies = {}) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+
+        if (queueFamilies.size() > 1) {
+            bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+            bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+        } else {
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        }
 
-        VkShaderModule shaderModule;
-        if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create shader module!");
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create buffer!");
         }
 
-        return shaderModule;
+        bufferMemory = allocator->allocateForBuffer(buffer, properties, preferredProperties);
+    }
+
+    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory,
+        uint32_t mipLevels = 1, const std::vector<uint32_t>& queueFamilies = {}) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = width;
+        imageInfo.extent.height = height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = mipLevels;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = format;
+        imageInfo.tiling = tiling;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+
+        if (queueFamilies.size() > 1) {
+            imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+            imageInfo.pQueueFamilyIndices = queueFamilies.data();
+        } else {
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        }
+
+        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create image!");
+        }
+
+        imageMemory = allocator->allocateForImage(image, tiling, properties);
+    }
+
+    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t baseMipLevel = 0, uint32_t levelCount = 1) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange.aspectMask = aspectFlags;
+        viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
+        viewInfo.subresourceRange.levelCount = levelCount;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        VkImageView imageView;
+        if (vkCreateImageView(device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create image view!");
+        }
+
+        return imageView;
+    }
+
+    VkFormat findDepthFormat() {
+        // sampled as well, since the depth pyramid is built from it
+        VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+        for (VkFormat format : {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT}) {
+            VkFormatProperties properties;
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+            if ((properties.optimalTilingFeatures & features) == features) {
+                return format;
+            }
+        }
+
+        throw std::runtime_error("failed to find supported depth format!");
     }
 
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats) {
@@ -771,26 +7286,51 @@ private:
     }
 
     VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
-        for (const auto& availablePresentMode : availablePresentModes) {
-            if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-                return availablePresentMode;
+        for (VkPresentModeKHR presentMode : presentModePreference()) {
+            if (std::find(availablePresentModes.begin(), availablePresentModes.end(), presentMode) != availablePresentModes.end()) {
+                return presentMode;
             }
         }
 
         return VK_PRESENT_MODE_FIFO_KHR;
     }
 
+    // FIFO can queue a whole swapchain of frames, FIFO_RELAXED tears only frames that missed their vblank,
+    // MAILBOX keeps about one refresh of latency without tearing and IMMEDIATE tears but adds none
+    std::vector<VkPresentModeKHR> presentModePreference() {
+        if (config.presentMode) {
+            return {config.presentMode.value()};
+        }
+
+        if (config.latencyTargetMs <= 0.0) {
+            return {VK_PRESENT_MODE_MAILBOX_KHR};
+        }
+
+        double refreshIntervalMs = 1000.0 / displayRefreshRate;
+        if (config.latencyTargetMs < refreshIntervalMs) {
+            return {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+        } else if (config.latencyTargetMs < 2.0 * refreshIntervalMs) {
+            return {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+        } else if (config.latencyTargetMs < 3.0 * refreshIntervalMs) {
+            return {VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+        }
+
+        return {VK_PRESENT_MODE_FIFO_KHR};
+    }
+
+    // monitor queries are main-thread only, so this runs once from initWindow()
+    double queryDisplayRefreshRate() {
+        GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+        const GLFWvidmode* mode = monitor != nullptr ? glfwGetVideoMode(monitor) : nullptr;
+
+        return mode != nullptr && mode->refreshRate > 0 ? mode->refreshRate : 60.0;
+    }
+
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
         if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
             return capabilities.currentExtent;
         } else {
-            int width, height;
-            glfwGetFramebufferSize(window, &width, &height);
-
-            VkExtent2D actualExtent = {
-                static_cast<uint32_t>(width),
-                static_cast<uint32_t>(height)
-            };
+            VkExtent2D actualExtent = framebufferExtent();
 
             actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
             actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
@@ -799,26 +7339,15 @@ private:
         }
     }
 
+    // only the surface capabilities are queried each time; the formats and present modes come from the cache
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device) {
         SwapChainSupportDetails details;
 
         vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
 
-        uint32_t formatCount;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
-
-        if (formatCount != 0) {
-            details.formats.resize(formatCount);
-            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
-        }
-
-        uint32_t presentModeCount;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
-
-        if (presentModeCount != 0) {
-            details.presentModes.resize(presentModeCount);
-            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
-        }
+        const DeviceCapabilities& caps = capabilities(device);
+        details.formats = caps.surfaceFormats;
+        details.presentModes = caps.presentModes;
 
         return details;
     }
@@ -828,69 +7357,85 @@ private:
 
         bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-        bool swapChainAdequate = false;
-        if (extensionsSupported) {
+        bool swapChainAdequate = config.headless;
+        if (extensionsSupported && !config.headless) {
             SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
             swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
         }
 
-        return indices.isComplete() && extensionsSupported && swapChainAdequate;
+        return indices.isComplete() && extensionsSupported && swapChainAdequate && supportsRequiredFeatures(device);
     }
 
     bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
-        uint32_t extensionCount;
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
-
-        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
-
-        std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
-
-        for (const auto& extension : availableExtensions) {
-            requiredExtensions.erase(extension.extensionName);
-        }
-
-        return requiredExtensions.empty();
+        const DeviceCapabilities& caps = capabilities(device);
+        return std::all_of(deviceExtensions.begin(), deviceExtensions.end(), [&](const char* extensionName) {
+            return caps.hasExtension(extensionName);
+        });
     }
 
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
-        QueueFamilyIndices indices;
+        return capabilities(device).queueFamilyIndices;
+    }
 
-        uint32_t queueFamilyCount = 0;
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+    QueueFamilyIndices queryQueueFamilies(VkPhysicalDevice device, const std::vector<VkQueueFamilyProperties>& queueFamilies) {
+        QueueFamilyIndices indices;
+        indices.presentRequired = surface != VK_NULL_HANDLE;
 
-        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+        // the family with the fewest other capabilities is the most likely to be a dedicated DMA engine
+        std::optional<uint32_t> transferFamily;
+        VkQueueFlags transferFamilyFlags = 0;
 
         int i = 0;
         for (const auto& queueFamily : queueFamilies) {
-            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+            // the graphics queue also runs the culling and depth pyramid compute passes
+            VkQueueFlags graphicsFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+            if ((queueFamily.queueFlags & graphicsFlags) == graphicsFlags && !indices.graphicsFamily) {
                 indices.graphicsFamily = i;
             }
 
             VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+            if (indices.presentRequired) {
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+            }
 
-            if (presentSupport) {
+            if (presentSupport && !indices.presentFamily) {
                 indices.presentFamily = i;
             }
 
-            if (indices.isComplete()) {
-                break;
+            VkQueueFlags otherFlags = queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+            if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+                (!transferFamily || otherFlags < transferFamilyFlags)) {
+                transferFamily = i;
+                transferFamilyFlags = otherFlags;
+            }
+
+            // timestamps are required so the culling passes stay in the GPU profile
+            if ((queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+                queueFamily.timestampValidBits > 0 && !indices.computeFamily) {
+                indices.computeFamily = i;
             }
 
             i++;
         }
 
+        indices.transferFamily = transferFamily ? transferFamily : indices.graphicsFamily;
+        if (indices.computeFamily == indices.transferFamily) {
+            indices.computeFamily.reset();
+        }
+
         return indices;
     }
 
     std::vector<const char*> getRequiredExtensions() {
-        uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions;
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        std::vector<const char*> extensions;
 
-        std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        if (!config.headless) {
+            uint32_t glfwExtensionCount = 0;
+            const char** glfwExtensions;
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+            extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        }
 
         if (enableValidationLayers) {
             extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -926,35 +7471,274 @@ private:
         return true;
     }
 
-    static std::vector<char> readFile(const std::string& filename) {
-        std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    static MappedFile readFile(const std::string& filename) {
+        return MappedFile(filename);
+    }
 
-        if (!file.is_open()) {
-            throw std::runtime_error("failed to open file!");
+    static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) {
+        std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+
+        return VK_FALSE;
+    }
+};
+
+VkPresentModeKHR parsePresentMode(const std::string& name) {
+    if (name == "fifo") return VK_PRESENT_MODE_FIFO_KHR;
+    if (name == "fifo-relaxed") return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+    if (name == "mailbox") return VK_PRESENT_MODE_MAILBOX_KHR;
+    if (name == "immediate") return VK_PRESENT_MODE_IMMEDIATE_KHR;
+
+    throw std::invalid_argument("unknown present mode " + name);
+}
+
+// "<width>x<height>"
+VkExtent2D parseExtent(const std::string& text) {
+    size_t separator = text.find('x');
+    if (separator == std::string::npos) {
+        throw std::invalid_argument("extent must look like 1920x1080, got " + text);
+    }
+
+    VkExtent2D extent = {
+        static_cast<uint32_t>(parseUnsigned("--extent width", text.substr(0, separator), UINT32_MAX)),
+        static_cast<uint32_t>(parseUnsigned("--extent height", text.substr(separator + 1), UINT32_MAX))
+    };
+    if (extent.width == 0 || extent.height == 0) {
+        throw std::invalid_argument("extent must not be empty, got " + text);
+    }
+
+    return extent;
+}
+
+AppConfig parseCommandLine(int argc, char** argv) {
+    AppConfig config;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("missing value for " + option);
+            }
+            return argv[++i];
+        };
+
+        if (option == "--frames-in-flight") {
+            config.framesInFlight = static_cast<uint32_t>(parseUnsigned(option, value(), UINT32_MAX));
+        } else if (option == "--latency-target-ms") {
+            config.latencyTargetMs = parseNumber(option, value());
+        } else if (option == "--present-mode") {
+            config.presentMode = parsePresentMode(value());
+        } else if (option == "--pace-frames") {
+            config.paceFrames = true;
+        } else if (option == "--no-async-compute") {
+            config.asyncCompute = false;
+        } else if (option == "--no-dynamic-rendering") {
+            config.dynamicRendering = false;
+        } else if (option == "--gpu") {
+            config.gpu = value();
+        } else if (option == "--msaa") {
+            config.msaaSamples = static_cast<uint32_t>(parseUnsigned(option, value(), UINT32_MAX));
+        } else if (option == "--target-fps") {
+            config.targetFps = parseNumber(option, value());
+        } else if (option == "--headless") {
+            config.headless = true;
+        } else if (option == "--frames") {
+            config.frameCount = static_cast<uint32_t>(parseUnsigned(option, value(), UINT32_MAX));
+        } else if (option == "--extent") {
+            config.headlessExtent = parseExtent(value());
+        } else if (option == "--dump-frames") {
+            config.dumpFramesDirectory = value();
+        } else if (option == "--trace") {
+            config.tracePath = value();
+        } else if (option == "--overlay") {
+            config.overlay = true;
+        } else if (option == "--stats") {
+            config.statsPath = value();
+        } else if (option == "--benchmark") {
+            config.benchmarkPath = value();
+        } else if (option == "--record") {
+            config.recordPath = value();
+        } else if (option == "--replay") {
+            config.replayPath = value();
+        } else if (option == "--mesh") {
+            config.meshPath = value();
+        } else if (option == "--generate-mesh") {
+            config.generateMeshPath = value();
+        } else if (option == "--mesh-triangles") {
+            config.generateMeshTriangles = parseUnsigned(option, value(), UINT64_MAX);
+        } else {
+            throw std::invalid_argument("unknown option " + option);
         }
+    }
+
+    if (config.framesInFlight < MIN_FRAMES_IN_FLIGHT || config.framesInFlight > MAX_FRAMES_IN_FLIGHT) {
+        throw std::invalid_argument("--frames-in-flight must be between " + std::to_string(MIN_FRAMES_IN_FLIGHT) + " and " + std::to_string(MAX_FRAMES_IN_FLIGHT));
+    }
 
-        size_t fileSize = (size_t) file.tellg();
-        std::vector<char> buffer(fileSize);
+    if (config.msaaSamples == 0 || config.msaaSamples > 64 || (config.msaaSamples & (config.msaaSamples - 1)) != 0) {
+        throw std::invalid_argument("--msaa must be a power of two up to 64");
+    }
 
-        file.seekg(0);
-        file.read(buffer.data(), fileSize);
+    if (config.targetFps < 0.0) {
+        throw std::invalid_argument("--target-fps must not be negative");
+    }
 
-        file.close();
+    if (!config.replayPath.empty() && !config.benchmarkPath.empty()) {
+        throw std::invalid_argument("--replay and --benchmark cannot be combined");
+    }
 
-        return buffer;
+    return config;
+}
+
+// Writes a rippled square grid as a .mesh file: vertices row by row, quads in the same order, so meshlets
+// taken in index order only ever reach a few rows ahead into the vertices.
+void generateGridMesh(const std::string& path, uint64_t triangleCount) {
+    const uint32_t TRIANGLES_PER_MESHLET = 64;
+    const float HEIGHT_SCALE = 0.05f;
+
+    uint64_t side = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::sqrt(triangleCount / 2.0))));
+    uint64_t columns = side + 1;
+    if (columns * columns > UINT32_MAX || side * side * 6 > UINT32_MAX) {
+        throw std::invalid_argument("too many triangles for a mesh file");
     }
 
-    static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) {
-        std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+    MeshFileHeader header{};
+    memcpy(header.magic, MESH_FILE_MAGIC, sizeof(MESH_FILE_MAGIC));
+    header.version = MESH_FILE_VERSION;
+    header.vertexCount = static_cast<uint32_t>(columns * columns);
+    header.indexCount = static_cast<uint32_t>(side * side * 6);
+    header.indexSize = header.vertexCount <= 65536 ? 2 : 4;
+    header.meshletCount = static_cast<uint32_t>((side * side * 2 + TRIANGLES_PER_MESHLET - 1) / TRIANGLES_PER_MESHLET);
+    float boundsMin[3] = {0.0f, 0.0f, -HEIGHT_SCALE};
+    float boundsMax[3] = {1.0f, 1.0f, HEIGHT_SCALE};
+    memcpy(header.boundsMin, boundsMin, sizeof(boundsMin));
+    memcpy(header.boundsMax, boundsMax, sizeof(boundsMax));
+    header.vertexOffset = (sizeof(MeshFileHeader) + 15) / 16 * 16;
+    header.indexOffset = header.vertexOffset + uint64_t(header.vertexCount) * sizeof(PackedVertex);
+    header.meshletOffset = (header.indexOffset + uint64_t(header.indexCount) * header.indexSize + 3) / 4 * 4;
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("failed to open mesh file for writing!");
+    }
 
-        return VK_FALSE;
+    auto pad = [&](uint64_t offset) {
+        while (static_cast<uint64_t>(file.tellp()) < offset) {
+            file.put(0);
+        }
+    };
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad(header.vertexOffset);
+
+    auto height = [&](float x, float y) {
+        return HEIGHT_SCALE * std::sin(x * 12.0f) * std::cos(y * 9.0f);
+    };
+    auto quantize = [](float value) {
+        return static_cast<uint16_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+    };
+
+    std::vector<PackedVertex> row(columns);
+    for (uint64_t y = 0; y < columns; y++) {
+        for (uint64_t x = 0; x < columns; x++) {
+            float u = static_cast<float>(x) / side;
+            float v = static_cast<float>(y) / side;
+            float z = height(u, v);
+
+            // octahedral encoding of the analytic normal
+            float normal[3] = {
+                -HEIGHT_SCALE * 12.0f * std::cos(u * 12.0f) * std::cos(v * 9.0f),
+                HEIGHT_SCALE * 9.0f * std::sin(u * 12.0f) * std::sin(v * 9.0f),
+                1.0f
+            };
+            float length = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+
+            PackedVertex& vertex = row[x];
+            vertex.position[0] = quantize(u);
+            vertex.position[1] = quantize(v);
+            vertex.position[2] = quantize((z - boundsMin[2]) / (boundsMax[2] - boundsMin[2]));
+            vertex.position[3] = 0;
+            vertex.normal[0] = static_cast<int16_t>(std::lround(normal[0] / length * 32767.0f));
+            vertex.normal[1] = static_cast<int16_t>(std::lround(normal[1] / length * 32767.0f));
+            vertex.uv[0] = quantize(u);
+            vertex.uv[1] = quantize(v);
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(PackedVertex));
     }
-};
 
-int main() {
-    HelloTriangleApplication app;
+    // two clockwise triangles per quad, and a meshlet every TRIANGLES_PER_MESHLET triangles
+    std::vector<Meshlet> meshlets;
+    Meshlet meshlet{};
+    uint32_t indexCount = 0;
+    uint32_t vertexEnd = 0;
+    auto writeTriangle = [&](uint32_t a, uint32_t b, uint32_t c) {
+        for (uint32_t index : {a, b, c}) {
+            if (header.indexSize == 2) {
+                uint16_t shortIndex = static_cast<uint16_t>(index);
+                file.write(reinterpret_cast<const char*>(&shortIndex), sizeof(shortIndex));
+            } else {
+                file.write(reinterpret_cast<const char*>(&index), sizeof(index));
+            }
+            vertexEnd = std::max(vertexEnd, index + 1);
+        }
+        indexCount += 3;
+
+        meshlet.indexCount += 3;
+        if (meshlet.indexCount == TRIANGLES_PER_MESHLET * 3 || indexCount == header.indexCount) {
+            meshlet.vertexEnd = vertexEnd;
+            meshlets.push_back(meshlet);
+            meshlet = Meshlet{};
+            meshlet.firstIndex = indexCount;
+        }
+    };
+
+    for (uint64_t y = 0; y < side; y++) {
+        for (uint64_t x = 0; x < side; x++) {
+            uint32_t topLeft = static_cast<uint32_t>(y * columns + x);
+            uint32_t bottomLeft = topLeft + static_cast<uint32_t>(columns);
+            writeTriangle(topLeft, topLeft + 1, bottomLeft);
+            writeTriangle(topLeft + 1, bottomLeft + 1, bottomLeft);
+        }
+    }
+
+    // bounding spheres from each meshlet's rows, which is all culling needs
+    for (auto& bounds : meshlets) {
+        uint64_t firstQuad = bounds.firstIndex / 6;
+        uint64_t lastQuad = (bounds.firstIndex + bounds.indexCount - 1) / 6;
+        float minCorner[2] = {
+            static_cast<float>(firstQuad / side == lastQuad / side ? firstQuad % side : 0) / side,
+            static_cast<float>(firstQuad / side) / side
+        };
+        float maxCorner[2] = {
+            static_cast<float>(firstQuad / side == lastQuad / side ? lastQuad % side + 1 : side) / side,
+            static_cast<float>(lastQuad / side + 1) / side
+        };
+
+        bounds.center[0] = 0.5f * (minCorner[0] + maxCorner[0]);
+        bounds.center[1] = 0.5f * (minCorner[1] + maxCorner[1]);
+        bounds.center[2] = 0.0f;
+        bounds.radius = std::sqrt(std::pow(maxCorner[0] - minCorner[0], 2.0f) + std::pow(maxCorner[1] - minCorner[1], 2.0f) +
+            std::pow(2.0f * HEIGHT_SCALE, 2.0f)) * 0.5f;
+    }
+
+    pad(header.meshletOffset);
+    file.write(reinterpret_cast<const char*>(meshlets.data()), meshlets.size() * sizeof(Meshlet));
+
+    if (!file) {
+        throw std::runtime_error("failed to write mesh file!");
+    }
 
+    std::cout << "wrote " << header.indexCount / 3 << " triangles in " << meshlets.size() << " meshlets to " << path << std::endl;
+}
+
+int main(int argc, char** argv) {
     try {
+        AppConfig config = parseCommandLine(argc, argv);
+        if (!config.generateMeshPath.empty()) {
+            generateGridMesh(config.generateMeshPath, config.generateMeshTriangles);
+            return EXIT_SUCCESS;
+        }
+
+        HelloTriangleApplication app(config);
         app.run();
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
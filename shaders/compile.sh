@@ -1,2 +1,12 @@
-$HOME/VulkanSDK/1.3.290.0/macOS/bin/glslc shader.vert -o vert.spv
-$HOME/VulkanSDK/1.3.290.0/macOS/bin/glslc shader.frag -o frag.spv
+#!/bin/sh
+# Uses $GLSLC if set, otherwise glslc from $VULKAN_SDK, otherwise glslc on the PATH.
+cd "$(dirname "$0")" || exit 1
+GLSLC="${GLSLC:-${VULKAN_SDK:+$VULKAN_SDK/bin/}glslc}"
+
+"$GLSLC" shader.vert -o vert.spv
+"$GLSLC" shader.frag -o frag.spv
+"$GLSLC" mesh.vert -o mesh.spv
+"$GLSLC" cull.comp -o cull.spv
+"$GLSLC" depth_pyramid.comp -o depth_pyramid.spv
+"$GLSLC" overlay.vert -o overlay_vert.spv
+"$GLSLC" overlay.frag -o overlay_frag.spv
@@ -0,0 +1,30 @@
+#version 450
+
+layout(push_constant) uniform PushConstants {
+    uint instanceStride;
+    vec4 meshScale;
+    vec4 meshOffset;
+} push;
+
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inUV;
+
+layout(location = 0) out vec3 fragColor;
+
+vec3 decodeOctahedral(vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (normal.z < 0.0) {
+        normal.xy = (1.0 - abs(normal.yx)) * mix(vec2(-1.0), vec2(1.0), step(0.0, normal.xy));
+    }
+    return normalize(normal);
+}
+
+void main() {
+    // positions arrive as [0, 1] within the mesh bounds
+    gl_Position = vec4(inPosition.xyz * push.meshScale.xyz + push.meshOffset.xyz, 1.0);
+
+    vec3 normal = decodeOctahedral(inNormal);
+    float light = max(dot(normal, normalize(vec3(0.3, -0.5, 0.8))), 0.1);
+    fragColor = vec3(inUV, 0.5) * light;
+}
@@ -0,0 +1,16 @@
+#version 450
+
+layout(location = 0) flat in uvec2 glyphBits;
+layout(location = 1) in vec2 fontPixel;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    uvec2 pixel = uvec2(fontPixel);
+    uint bit = pixel.y * 5 + pixel.x;
+    uint word = bit < 32 ? glyphBits.x : glyphBits.y;
+    bool lit = pixel.x < 5 && pixel.y < 7 && ((word >> (bit % 32)) & 1u) != 0;
+
+    // lit pixels over a translucent backdrop, so the text reads over any scene
+    outColor = lit ? vec4(1.0, 1.0, 0.8, 1.0) : vec4(0.0, 0.0, 0.0, 0.6);
+}
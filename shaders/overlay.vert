@@ -0,0 +1,54 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// set 1 is the bindless set; the push constants say which of its buffers holds this frame's glyphs, one
+// uint each: text column in bits 0-7, row in bits 8-15, character - 32 in bits 16-21
+layout(std430, set = 1, binding = 0) readonly buffer Glyphs {
+    uint glyphs[];
+} glyphBuffers[];
+
+// matches OverlayPushConstants
+layout(push_constant) uniform PushConstants {
+    uint glyphBuffer;
+    uint glyphCount;
+    vec2 cellSize;
+    vec2 origin;
+} push;
+
+// 5x7 bitmaps for ASCII 32-95, bit y * 5 + x of each uvec2 set where the glyph is lit
+const uint FONT[128] = uint[](
+    0x00000000u, 0x0u, 0x00421084u, 0x1u, 0x00000000u, 0x0u, 0x00000000u, 0x0u,  // space ! " #
+    0x00000000u, 0x0u, 0x32222263u, 0x6u, 0x00000000u, 0x0u, 0x00000000u, 0x0u,  // $ % & '
+    0x08210888u, 0x2u, 0x88842082u, 0x0u, 0x00000000u, 0x0u, 0x084f9080u, 0x0u,  // ( ) * +
+    0x10c00000u, 0x1u, 0x000f8000u, 0x0u, 0x8c000000u, 0x1u, 0x02222200u, 0x0u,  // , - . /
+    0xa33ae62eu, 0x3u, 0x884210c4u, 0x3u, 0xc444422eu, 0x7u, 0xa304111fu, 0x3u,  // 0 1 2 3
+    0x11f4a988u, 0x2u, 0xa3083c3fu, 0x3u, 0xa317844cu, 0x3u, 0x8422221fu, 0x0u,  // 4 5 6 7
+    0xa317462eu, 0x3u, 0x910f462eu, 0x1u, 0x0c6018c0u, 0x0u, 0x00000000u, 0x0u,  // 8 9 : ;
+    0x00000000u, 0x0u, 0x01f07c00u, 0x0u, 0x00000000u, 0x0u, 0x0044422eu, 0x1u,  // < = > ?
+    0x00000000u, 0x0u, 0x631fc62eu, 0x4u, 0xe317c62fu, 0x3u, 0xa210862eu, 0x3u,  // @ A B C
+    0xd318c527u, 0x1u, 0xc217843fu, 0x7u, 0x4217843fu, 0x0u, 0xa31e862eu, 0x7u,  // D E F G
+    0x631fc631u, 0x4u, 0x8842108eu, 0x3u, 0x9284211cu, 0x1u, 0x52519531u, 0x4u,  // H I J K
+    0xc2108421u, 0x7u, 0x631ad771u, 0x4u, 0x639ace31u, 0x4u, 0xa318c62eu, 0x3u,  // L M N O
+    0x4217c62fu, 0x0u, 0x9358c62eu, 0x5u, 0x5257c62fu, 0x4u, 0xe107043eu, 0x3u,  // P Q R S
+    0x0842109fu, 0x1u, 0xa318c631u, 0x3u, 0x1518c631u, 0x1u, 0xab5ac631u, 0x2u,  // T U V W
+    0x62a22a31u, 0x4u, 0x08422a31u, 0x1u, 0xc222221fu, 0x7u, 0x00000000u, 0x0u,  // X Y Z [
+    0x00000000u, 0x0u, 0x00000000u, 0x0u, 0x00000000u, 0x0u, 0xc0000000u, 0x7u  // \ ] ^ _
+);
+
+// two triangles per glyph, six vertices, no vertex buffer
+const vec2 CORNERS[6] = vec2[](vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(0.0, 1.0), vec2(0.0, 1.0), vec2(1.0, 0.0), vec2(1.0, 1.0));
+
+layout(location = 0) flat out uvec2 glyphBits;
+layout(location = 1) out vec2 fontPixel;
+
+void main() {
+    uint glyph = glyphBuffers[push.glyphBuffer].glyphs[gl_VertexIndex / 6];
+    vec2 cell = vec2(glyph & 0xffu, (glyph >> 8) & 0xffu);
+    uint character = (glyph >> 16) & 0x3fu;
+    vec2 corner = CORNERS[gl_VertexIndex % 6];
+
+    gl_Position = vec4(push.origin + (cell + corner) * push.cellSize, 0.0, 1.0);
+    glyphBits = uvec2(FONT[character * 2], FONT[character * 2 + 1]);
+    // a cell is 6x9 font pixels, the glyph in its top left 5x7
+    fontPixel = corner * vec2(6.0, 9.0);
+}
@@ -1,20 +1,46 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
-layout(location = 0) out vec3 fragColor;
+// one column per instance attribute, each instanceStride floats long; see InstanceData
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    float columns[];
+} instances;
+
+// the instances that survived culling, for draws from the culled indirect buffer
+layout(std430, set = 0, binding = 1) readonly buffer VisibleInstances {
+    uint indices[];
+} visible;
+
+// set 1 is the bindless set; the push constants say which of its buffers is the material table
+layout(std430, set = 1, binding = 0) readonly buffer Materials {
+    vec4 tints[];
+} materials[];
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+layout(push_constant) uniform PushConstants {
+    uint instanceStride;
+    uint visibleInstances;
+    uint materialTable;
+    uint materialCount;
+} push;
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec3 fragColor;
+
+float instanceColumn(uint column, uint instance) {
+    return instances.columns[column * push.instanceStride + instance];
+}
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
+    uint instance = push.visibleInstances != 0 ? visible.indices[gl_InstanceIndex] : uint(gl_InstanceIndex);
+
+    vec2 position = vec2(instanceColumn(0, instance), instanceColumn(1, instance));
+    float scale = instanceColumn(2, instance);
+    float rotation = instanceColumn(3, instance);
+    uint materialId = floatBitsToUint(instanceColumn(4, instance));
+
+    mat2 rotate = mat2(cos(rotation), sin(rotation), -sin(rotation), cos(rotation));
+    gl_Position = vec4(rotate * inPosition * scale + position, 0.0, 1.0);
+    fragColor = inColor * materials[push.materialTable].tints[materialId % push.materialCount].rgb;
 }